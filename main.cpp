@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -10,6 +11,37 @@
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <assimp/Importer.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
 #include "./stb_image.h"
 
 int WIDTH = 1920;
@@ -55,8 +87,8 @@ void UpdateTimer(){
 }
 
 void UpdateWindow(){
-  double x;
-  double y;
+  int x;
+  int y;
 
   glfwGetWindowSize(window, &x, &y);
 
@@ -64,264 +96,4880 @@ void UpdateWindow(){
   HEIGHT = y;
 }
 
-class Shader{
-private:
-  unsigned int mId;
+// 64-bit content hash, four independent lanes so large files hash at memory speed
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0){
+  const uint64_t k = 0x9E3779B97F4A7C15ull;
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  uint64_t h[4] = {seed ^ k, seed + k, seed ^ (k >> 7), seed - k};
 
-  std::string LoadFile(const std::string& path){
-    std::string code;
-    std::ifstream file;
-    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try{
-      file.open(path);
-      std::stringstream stream;
-      stream << file.rdbuf();
-      file.close();
-      code = stream.str();
-    }
-    catch(const std::ifstream::failure& e){
-      std::cerr<<"ERROR: "<<e.what()<<std::endl;
-      exit(1);
+  while(size >= 32){
+    for(int i = 0; i < 4; i++){
+      uint64_t w;
+      memcpy(&w, p + i * 8, 8);
+      h[i] = (h[i] ^ w) * k;
+      h[i] ^= h[i] >> 29;
     }
-    return code;
+    p += 32;
+    size -= 32;
   }
 
-  unsigned int CompileShader(const std::string& srcCode, bool isVert){
-    const char* code = srcCode.c_str();
-    int success;
-    char infoLog[512];
-    unsigned int shader = isVert? glCreateShader(GL_VERTEX_SHADER) : glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(shader, 1, &code, nullptr);
-    glCompileShader(shader);
+  uint64_t tail = 0xCBF29CE484222325ull;
+  while(size--) tail = (tail ^ *p++) * 0x100000001B3ull;
 
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if(!success){
-      glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-      std::cerr<<"ERROR: compiling "<<(isVert?" vertex":" fragment")<<" shader -> "<<infoLog<<std::endl;
-      exit(1);
+  uint64_t r = tail;
+  for(int i = 0; i < 4; i++){
+    r = (r ^ h[i]) * k;
+    r ^= r >> 31;
+  }
+  return r;
+}
+
+class MappedFile{
+  friend class AssetArchive;
+
+private:
+  const unsigned char* mData;
+  size_t mSize;
+  // set when the bytes are a span of a mounted archive, the archive stays mapped while a span is open
+  std::shared_ptr<const MappedFile> mArchive;
+
+public:
+  MappedFile(): mData(nullptr), mSize(0){}
+  ~MappedFile(){Close();}
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept : mData(other.mData), mSize(other.mSize), mArchive(std::move(other.mArchive)){other.mData = nullptr; other.mSize = 0;}
+  MappedFile& operator=(MappedFile&& other) noexcept{
+    if(this != &other){
+      Close();
+      mData = other.mData;
+      mSize = other.mSize;
+      mArchive = std::move(other.mArchive);
+      other.mData = nullptr;
+      other.mSize = 0;
     }
-    return shader;
+    return *this;
   }
 
-  void CreateShaderProgram(unsigned int& vert, unsigned int& frag){
-    mId = glCreateProgram();
-    glAttachShader(mId, vert);
-    glAttachShader(mId, frag);
-    glLinkProgram(mId);
+  // mounted archives are searched before the filesystem, see AssetArchive.
+  // advice is an madvise hint for the whole range, MADV_SEQUENTIAL for files that are read front to back
+  bool Open(const std::string& path, int advice = MADV_NORMAL);
 
-    int success;
-    char infoLog[512];
+  // maps path itself, never an archive entry
+  bool OpenFile(const std::string& path, int advice = MADV_NORMAL){
+    Close();
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
 
-    glGetProgramiv(mId, GL_LINK_STATUS, &success);
-    if(!success){
-      glGetProgramInfoLog(mId, 512, nullptr, infoLog);
-      std::cerr<<"ERROR: linking shader program -> "<<infoLog<<std::endl;
-      exit(1);
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size <= 0){
+      close(fd);
+      return false;
     }
 
-    glDeleteShader(vert);
-    glDeleteShader(frag);
+    void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED) return false;
 
-    std::cout<<"Successfully created shader program!"<<std::endl;
+    if(advice != MADV_NORMAL) madvise(ptr, st.st_size, advice);
+
+    mData = static_cast<const unsigned char*>(ptr);
+    mSize = st.st_size;
+    return true;
   }
 
+  void Close(){
+    if(mData && !mArchive) munmap(const_cast<unsigned char*>(mData), mSize);
+    mArchive.reset();
+    mData = nullptr;
+    mSize = 0;
+  }
+
+  bool IsOpen() const {return mData != nullptr;}
+  const unsigned char* Data() const {return mData;}
+  size_t Size() const {return mSize;}
+};
+
+class BinaryWriter{
+private:
+  std::vector<unsigned char> mBuffer;
+
 public:
-  Shader(const std::string& vertPath, const std::string& fragPath){
-    std::string vCode = LoadFile(vertPath);
-    std::string fCode = LoadFile(fragPath);
-    unsigned int vert = CompileShader(vCode, true);
-    unsigned int frag = CompileShader(fCode, false);
-    CreateShaderProgram(vert, frag);
+  template <typename T>
+  void Write(const T& val){Write(&val, sizeof(T));}
+
+  void Write(const void* data, size_t size){
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    mBuffer.insert(mBuffer.end(), p, p + size);
   }
 
-  ~Shader() {glDeleteProgram(mId);}
+  void WriteString(const std::string& str){
+    Write<uint32_t>(str.size());
+    Write(str.data(), str.size());
+  }
+
+  void Align(size_t alignment){
+    while(mBuffer.size() % alignment) mBuffer.push_back(0);
+  }
+
+  bool SaveToFile(const std::string& path) const{
+    // write to a temporary and rename so readers never see a half-written file
+    const std::string tmp = path + ".tmp";
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if(!file) return false;
+    file.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+    file.close();
+    if(!file) return false;
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+  }
+};
+
+class BinaryReader{
+private:
+  const unsigned char* mData;
+  size_t mSize;
+  size_t mOffset;
 
-  void Use() {glUseProgram(mId);}
+public:
+  BinaryReader(const unsigned char* data, size_t size): mData(data), mSize(size), mOffset(0){}
 
   template <typename T>
-  void SetValue(const std::string& name, const T& val){
-    const unsigned int loc = glGetUniformLocation(mId, name.c_str());
+  bool Read(T& val){
+    if(mSize - mOffset < sizeof(T)) return false;
+    memcpy(&val, mData + mOffset, sizeof(T));
+    mOffset += sizeof(T);
+    return true;
+  }
+
+  // returns a pointer into the underlying buffer, no copy is made
+  const unsigned char* Skip(size_t size){
+    if(mSize - mOffset < size) return nullptr;
+    const unsigned char* p = mData + mOffset;
+    mOffset += size;
+    return p;
+  }
 
-    if constexpr(std::is_same_v<T,int>) glUniform1i(mId, val);
-    else if constexpr(std::is_same_v<T,bool>) glUniform1i(mId, (int)val);
-    else if constexpr(std::is_same_v<T,float>) glUniform1f(mId, val);
-    else if constexpr(std::is_same_v<T,glm::vec2>) glUniform2fv(mId, 1, glm::value_ptr(val));
-    else if constexpr(std::is_same_v<T,glm::vec3>) glUniform3fv(mId, 1, glm::value_ptr(val));
-    else if constexpr(std::is_same_v<T,glm::mat4>) glUniformMatrix4fv(mId, 1, GL_FALSE, glm::value_ptr(val));
+  bool ReadString(std::string& str){
+    uint32_t len;
+    if(!Read(len)) return false;
+    const unsigned char* p = Skip(len);
+    if(!p) return false;
+    str.assign(reinterpret_cast<const char*>(p), len);
+    return true;
+  }
+
+  bool Align(size_t alignment){
+    size_t aligned = (mOffset + alignment - 1) / alignment * alignment;
+    if(aligned > mSize) return false;
+    mOffset = aligned;
+    return true;
   }
 };
 
-class VBO{
+// packed asset archive, written by --pack and mounted with --archive:
+//   AssetArchiveHeader
+//   entryCount AssetArchiveEntry records sorted by name hash, read in place
+//   name table (paths relative to the packed root)
+//   blobs, each aligned to ASSET_ARCHIVE_ALIGNMENT so the 16-byte aligned sections of mesh and
+//   texture caches keep their alignment inside it
+const char ASSET_ARCHIVE_MAGIC[4] = {'P','B','R','A'};
+const uint32_t ASSET_ARCHIVE_VERSION = 1;
+const uint64_t ASSET_ARCHIVE_ALIGNMENT = 64;
+
+struct AssetArchiveHeader{
+  char magic[4];
+  uint32_t version;
+  uint64_t entryCount;
+  uint64_t namesOffset;
+  uint64_t namesSize;
+};
+
+struct AssetArchiveEntry{
+  uint64_t nameHash;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t nameOffset;
+  uint32_t nameSize;
+};
+
+class AssetArchive{
 private:
-  unsigned int mId;
+  std::shared_ptr<MappedFile> mFile;
+  std::string mRoot;
+  const AssetArchiveEntry* mEntries;
+  uint64_t mEntryCount;
+  const char* mNames;
+  // per entry, set when Mount found the loose file newer than the archive, empty unless checked
+  std::vector<bool> mStale;
+
+  AssetArchive(): mEntries(nullptr), mEntryCount(0), mNames(nullptr){}
+
+  // mounted once at startup before any loading thread runs, read without locking afterwards
+  static std::vector<std::unique_ptr<AssetArchive>>& Mounted(){
+    static std::vector<std::unique_ptr<AssetArchive>> archives;
+    return archives;
+  }
+
+  // name relative to the mount root, or false for paths outside it
+  bool Relative(const std::string& path, std::string& name) const{
+    name = NormalizePath(path);
+    if(mRoot.empty()) return name.empty() || name[0] != '/';
+    if(name.size() <= mRoot.size() || name.compare(0, mRoot.size(), mRoot) != 0 || name[mRoot.size()] != '/') return false;
+    name.erase(0, mRoot.size() + 1);
+    return true;
+  }
+
+  const AssetArchiveEntry* FindEntry(const std::string& name) const{
+    const uint64_t hash = HashBytes(name.data(), name.size());
+    const AssetArchiveEntry* end = mEntries + mEntryCount;
+    const AssetArchiveEntry* it = std::lower_bound(mEntries, end, hash, [](const AssetArchiveEntry& e, uint64_t h){return e.nameHash < h;});
+    for(; it != end && it->nameHash == hash; it++)
+      if(name.compare(0, std::string::npos, mNames + it->nameOffset, it->nameSize) == 0) return it;
+    return nullptr;
+  }
+
+  static bool ListFiles(const std::string& root, const std::string& relative, std::vector<std::string>& files){
+    DIR* dir = opendir((root + "/" + relative).c_str());
+    if(!dir) return false;
+    while(dirent* entry = readdir(dir)){
+      const std::string name = entry->d_name;
+      if(name == "." || name == "..") continue;
+      const std::string path = relative.empty()? name : relative + "/" + name;
+      struct stat st;
+      if(stat((root + "/" + path).c_str(), &st) != 0) continue;
+      if(S_ISDIR(st.st_mode)) ListFiles(root, path, files);
+      else if(S_ISREG(st.st_mode)) files.push_back(path);
+    }
+    closedir(dir);
+    return true;
+  }
 
 public:
-  VBO(){glGenBuffers(1, &mId);}
-  ~VBO(){glDeleteBuffers(1, &mId);}
+  // lexical only: drops "." and empty components and folds "dir/.."
+  static std::string NormalizePath(const std::string& path){
+    const bool absolute = !path.empty() && path[0] == '/';
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while(start <= path.size()){
+      size_t end = path.find('/', start);
+      if(end == std::string::npos) end = path.size();
+      const std::string part = path.substr(start, end - start);
+      if(part == ".."){
+        if(!parts.empty() && parts.back() != "..") parts.pop_back();
+        else if(!absolute) parts.push_back(part);
+      }
+      else if(!part.empty() && part != ".") parts.push_back(part);
+      start = end + 1;
+    }
+    std::string normalized = absolute? "/" : "";
+    for(size_t i = 0; i < parts.size(); i++) normalized += (i? "/" : "") + parts[i];
+    return normalized;
+  }
 
-  VBO(const VBO&) = delete;
-  VBO(VBO&& other) noexcept : mId(other.mId){other.mId = 0;}
-  VBO& operator=(VBO&& other) noexcept{
-    if(this != other){
-      glDeleteBuffers(1, &mId);
-      mId = other.mId;
-      other.mId = 0;
+  // serves every packed file as if it were on disk below root. checkStale stats each entry's loose
+  // file once here, and those written after the archive win so rebuilt caches take effect before
+  // the next --pack. lookups never touch the filesystem
+  static bool Mount(const std::string& archivePath, const std::string& root, bool checkStale = false){
+    std::unique_ptr<AssetArchive> archive(new AssetArchive());
+    archive->mFile = std::make_shared<MappedFile>();
+    if(!archive->mFile->OpenFile(archivePath)) return false;
+    const unsigned char* data = archive->mFile->Data();
+    const uint64_t size = archive->mFile->Size();
+
+    BinaryReader reader(data, size);
+    AssetArchiveHeader header;
+    if(!reader.Read(header)) return false;
+    if(memcmp(header.magic, ASSET_ARCHIVE_MAGIC, 4) != 0 || header.version != ASSET_ARCHIVE_VERSION) return false;
+    if(header.entryCount > size / sizeof(AssetArchiveEntry)) return false;
+    const unsigned char* entries = reader.Skip(header.entryCount * sizeof(AssetArchiveEntry));
+    if(!entries || header.namesOffset > size || header.namesSize > size - header.namesOffset) return false;
+
+    archive->mEntries = reinterpret_cast<const AssetArchiveEntry*>(entries);
+    archive->mEntryCount = header.entryCount;
+    archive->mNames = reinterpret_cast<const char*>(data + header.namesOffset);
+    for(uint64_t i = 0; i < header.entryCount; i++){
+      const AssetArchiveEntry& entry = archive->mEntries[i];
+      if(entry.offset > size || entry.size > size - entry.offset) return false;
+      if((uint64_t)entry.nameOffset + entry.nameSize > header.namesSize) return false;
+      if(i > 0 && entry.nameHash < archive->mEntries[i - 1].nameHash) return false;
     }
-    return *this;
+
+    archive->mRoot = NormalizePath(root);
+    if(checkStale){
+      struct stat st;
+      if(stat(archivePath.c_str(), &st) != 0) return false;
+      const struct timespec packed = st.st_mtim;
+      archive->mStale.resize(header.entryCount);
+      for(uint64_t i = 0; i < header.entryCount; i++){
+        const AssetArchiveEntry& entry = archive->mEntries[i];
+        const std::string name(archive->mNames + entry.nameOffset, entry.nameSize);
+        const std::string path = archive->mRoot.empty()? name : archive->mRoot + "/" + name;
+        if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if(st.st_mtim.tv_sec > packed.tv_sec || (st.st_mtim.tv_sec == packed.tv_sec && st.st_mtim.tv_nsec > packed.tv_nsec)){
+          std::cerr<<"WARNING: "<<path<<" is newer than its archived copy, the archive needs repacking"<<std::endl;
+          archive->mStale[i] = true;
+        }
+      }
+    }
+    Mounted().push_back(std::move(archive));
+    return true;
   }
 
-  void Bind(){glBindBuffer(GL_ARRAY_BUFFER, mId);}
-  void Unbind(){glBindBuffer(GL_ARRAY_BUFFER, mId);}
+  // points file at the packed bytes without copying, with advice applied to the pages it covers
+  static bool Find(const std::string& path, MappedFile& file, int advice){
+    std::string name;
+    for(auto& archive: Mounted()){
+      if(!archive->Relative(path, name)) continue;
+      const AssetArchiveEntry* entry = archive->FindEntry(name);
+      if(!entry) continue;
+      if(!archive->mStale.empty() && archive->mStale[entry - archive->mEntries]) return false;
 
-  void AllocateMem(size_t size, GLenum usage){glBufferData(GL_ARRAY_BUFFER, size, nullptr, usage);}
-  void FillMem(size_t offset, size_t size, const void* data, GLenum usage){glBufferSubData(GL_ARRAY_BUFFER, offset, size, data, usage);}
-  void AllocateAndFillMem(size_t size, const void* data, GLenum usage){glBufferData(GL_ARRAY_BUFFER, size, data, usage);}
+      file.mData = archive->mFile->Data() + entry->offset;
+      file.mSize = entry->size;
+      file.mArchive = archive->mFile;
+      if(advice != MADV_NORMAL && entry->size){
+        const uintptr_t page = sysconf(_SC_PAGESIZE);
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(file.mData) / page * page;
+        madvise(reinterpret_cast<void*>(begin), reinterpret_cast<uintptr_t>(file.mData) + entry->size - begin, advice);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  static bool Contains(const std::string& path){
+    std::string name;
+    for(auto& archive: Mounted())
+      if(archive->Relative(path, name) && archive->FindEntry(name)) return true;
+    return false;
+  }
+
+  // writes every regular file below root, blobs are streamed from their own mappings
+  static bool Pack(const std::string& archivePath, const std::string& root){
+    std::vector<std::string> files;
+    if(!ListFiles(root, "", files)) return false;
+    const std::string archiveName = NormalizePath(archivePath);
+    files.erase(std::remove_if(files.begin(), files.end(), [&](const std::string& name){
+      return NormalizePath(root + "/" + name) == archiveName || (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0);
+    }), files.end());
+
+    std::vector<AssetArchiveEntry> entries(files.size());
+    std::string names;
+    for(size_t i = 0; i < files.size(); i++){
+      entries[i].nameHash = HashBytes(files[i].data(), files[i].size());
+      entries[i].nameOffset = names.size();
+      entries[i].nameSize = files[i].size();
+      names += files[i];
+    }
+    std::vector<size_t> order(files.size());
+    for(size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b){return entries[a].nameHash < entries[b].nameHash;});
+
+    AssetArchiveHeader header = {};
+    memcpy(header.magic, ASSET_ARCHIVE_MAGIC, 4);
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.entryCount = files.size();
+    header.namesOffset = sizeof(AssetArchiveHeader) + files.size() * sizeof(AssetArchiveEntry);
+    header.namesSize = names.size();
+
+    std::vector<MappedFile> sources(files.size());
+    uint64_t offset = header.namesOffset + header.namesSize;
+    for(size_t i: order){
+      struct stat st;
+      if(stat((root + "/" + files[i]).c_str(), &st) != 0) return false;
+      if(st.st_size > 0 && !sources[i].OpenFile(root + "/" + files[i], MADV_SEQUENTIAL)) return false;
+      offset = (offset + ASSET_ARCHIVE_ALIGNMENT - 1) / ASSET_ARCHIVE_ALIGNMENT * ASSET_ARCHIVE_ALIGNMENT;
+      entries[i].offset = offset;
+      entries[i].size = sources[i].Size();
+      offset += entries[i].size;
+    }
+
+    const std::string tmp = archivePath + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if(!out) return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(size_t i: order) out.write(reinterpret_cast<const char*>(&entries[i]), sizeof(AssetArchiveEntry));
+    out.write(names.data(), names.size());
+    uint64_t written = header.namesOffset + header.namesSize;
+    static const char padding[ASSET_ARCHIVE_ALIGNMENT] = {};
+    for(size_t i: order){
+      out.write(padding, entries[i].offset - written);
+      out.write(reinterpret_cast<const char*>(sources[i].Data()), sources[i].Size());
+      written = entries[i].offset + entries[i].size;
+      sources[i].Close();
+    }
+    out.close();
+    if(!out) return false;
+    std::cout<<"packed "<<files.size()<<" files, "<<written / 1024<<" KB -> "<<archivePath<<std::endl;
+    return std::rename(tmp.c_str(), archivePath.c_str()) == 0;
+  }
 };
 
-class EBO{
+bool MappedFile::Open(const std::string& path, int advice){
+  Close();
+  if(AssetArchive::Find(path, *this, advice)) return true;
+  return OpenFile(path, advice);
+}
+
+// read-only Assimp stream over a mapping, reads are plain copies with no syscalls
+class MappedIOStream : public Assimp::IOStream{
 private:
-  unsigned int mId;
+  std::shared_ptr<MappedFile> mFile;
+  size_t mPosition;
 
 public:
-  EBO(){glGenBuffers(1, &mId);}
-  ~EBO(){glDeleteBuffers(1, &mId);}
+  MappedIOStream(std::shared_ptr<MappedFile> file): mFile(std::move(file)), mPosition(0){}
 
-  EBO(const EBO&) = delete;
-  EBO(EBO&& other) noexcept : mId(other.mId){other.mId = 0;}
-  EBO& operator=(EBO&& other) noexcept{
-    if(this != other){
-      glDeleteBuffers(1, &mId);
-      mId = other.mId;
-      other.mId = 0;
+  size_t Read(void* buffer, size_t size, size_t count) override{
+    if(size == 0 || count == 0) return 0;
+    const size_t available = (mFile->Size() - mPosition) / size;
+    count = std::min(count, available);
+    memcpy(buffer, mFile->Data() + mPosition, size * count);
+    mPosition += size * count;
+    return count;
+  }
+
+  size_t Write(const void*, size_t, size_t) override{return 0;}
+
+  aiReturn Seek(size_t offset, aiOrigin origin) override{
+    size_t position;
+    if(origin == aiOrigin_SET) position = offset;
+    else if(origin == aiOrigin_CUR) position = mPosition + offset;
+    else position = mFile->Size() + offset;
+    if(position > mFile->Size()) return aiReturn_FAILURE;
+    mPosition = position;
+    return aiReturn_SUCCESS;
+  }
+
+  size_t Tell() const override{return mPosition;}
+  size_t FileSize() const override{return mFile->Size();}
+  void Flush() override{}
+};
+
+// serves every file Assimp opens (the model and its .mtl/.bin siblings) from read-only mappings.
+// files mapped beforehand, like the model itself for hashing, are handed over with Preload
+class MappedIOSystem : public Assimp::IOSystem{
+private:
+  std::unordered_map<std::string, std::shared_ptr<MappedFile>> mPreloaded;
+
+public:
+  void Preload(const std::string& path, std::shared_ptr<MappedFile> file){mPreloaded[path] = std::move(file);}
+
+  bool Exists(const char* path) const override{
+    struct stat st;
+    return mPreloaded.count(path) || AssetArchive::Contains(path) || (stat(path, &st) == 0 && S_ISREG(st.st_mode));
+  }
+
+  char getOsSeparator() const override{return '/';}
+
+  Assimp::IOStream* Open(const char* path, const char* mode = "rb") override{
+    if(strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+')) return nullptr;
+
+    auto it = mPreloaded.find(path);
+    if(it != mPreloaded.end()) return new MappedIOStream(it->second);
+
+    auto file = std::make_shared<MappedFile>();
+    if(!file->Open(path, MADV_SEQUENTIAL)) return nullptr;
+    return new MappedIOStream(std::move(file));
+  }
+
+  void Close(Assimp::IOStream* stream) override{delete stream;}
+};
+
+// wall-clock spans of startup work from every thread (phases in main, per-model import, per-texture
+// decode, uploads, shader builds), reported at exit as a summary and a Chrome trace. upload spans
+// cover the CPU side of the GL calls, the driver may finish the copy later
+class Profiler{
+private:
+  struct Event{
+    std::string name;
+    const char* category;
+    int64_t start;
+    int64_t duration; // -1 for instant marks
+    uint32_t thread;
+  };
+
+  const std::chrono::steady_clock::time_point mOrigin;
+  std::vector<Event> mEvents;
+  std::mutex mMutex;
+
+  Profiler(): mOrigin(std::chrono::steady_clock::now()){}
+
+  static std::string Escape(const std::string& str){
+    std::string escaped;
+    for(char c: str){
+      if(c == '"' || c == '\\') escaped += '\\';
+      if((unsigned char)c < 0x20) c = ' ';
+      escaped += c;
     }
-    return *this;
+    return escaped;
   }
 
-  void Bind(){glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mId);}
-  void Unbind(){glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mId);}
+public:
+  // the first call fixes time zero, main makes it before anything else
+  static Profiler& Get(){
+    static Profiler profiler;
+    return profiler;
+  }
 
-  void AllocateMem(size_t size, GLenum usage){glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, nullptr, usage);}
-  void FillMem(size_t offset, size_t size, const void* data, GLenum usage){glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, size, data, usage);}
-  void AllocateAndFillMem(size_t size, const void* data, GLenum usage){glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, usage);}
+  // microseconds since time zero
+  int64_t Now() const{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mOrigin).count();
+  }
+
+  // small stable ids for the trace, in order of first use
+  static uint32_t ThreadIndex(){
+    static std::atomic<uint32_t> next{0};
+    thread_local const uint32_t index = next++;
+    return index;
+  }
+
+  void Record(std::string name, const char* category, int64_t start, int64_t end){
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEvents.push_back({std::move(name), category, start, end - start, ThreadIndex()});
+  }
+
+  // a point in time such as the first presented frame
+  void Mark(std::string name){
+    const int64_t now = Now();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEvents.push_back({std::move(name), "mark", now, -1, ThreadIndex()});
+  }
+
+  // startup phases in order, totals per category with their slowest items, then the marks
+  void WriteSummary(std::ostream& out){
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<const Event*> events;
+    for(auto& event: mEvents) events.push_back(&event);
+    std::stable_sort(events.begin(), events.end(), [](const Event* a, const Event* b){return a->start < b->start;});
+
+    out<<"startup profile (ms):"<<std::endl;
+    for(const Event* event: events)
+      if(strcmp(event->category, "startup") == 0) out<<"  "<<event->name<<": "<<event->duration / 1000.0<<std::endl;
+
+    std::map<std::string, std::vector<const Event*>> categories;
+    for(const Event* event: events)
+      if(event->duration >= 0 && strcmp(event->category, "startup") != 0) categories[event->category].push_back(event);
+    for(auto& category: categories){
+      std::vector<const Event*>& list = category.second;
+      int64_t total = 0;
+      for(const Event* event: list) total += event->duration;
+      out<<"  "<<category.first<<": "<<list.size()<<" spans, "<<total / 1000.0<<" total"<<std::endl;
+      std::sort(list.begin(), list.end(), [](const Event* a, const Event* b){return a->duration > b->duration;});
+      for(size_t i = 0; i < list.size() && i < 5; i++) out<<"    "<<list[i]->name<<": "<<list[i]->duration / 1000.0<<std::endl;
+    }
+
+    for(const Event* event: events)
+      if(event->duration < 0) out<<"  "<<event->name<<" at "<<event->start / 1000.0<<std::endl;
+  }
+
+  // chrome://tracing / Perfetto "Trace Event Format"
+  bool WriteTrace(const std::string& path){
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::ofstream file(path, std::ios::trunc);
+    if(!file) return false;
+    file<<"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for(size_t i = 0; i < mEvents.size(); i++){
+      const Event& event = mEvents[i];
+      file<<(i? ",\n" : "\n")<<"{\"name\":\""<<Escape(event.name)<<"\",\"cat\":\""<<event.category<<"\",\"pid\":1,\"tid\":"<<event.thread<<",\"ts\":"<<event.start;
+      if(event.duration >= 0) file<<",\"ph\":\"X\",\"dur\":"<<event.duration<<"}";
+      else file<<",\"ph\":\"i\",\"s\":\"g\"}";
+    }
+    file<<"\n]}"<<std::endl;
+    return (bool)file;
+  }
+};
+
+// records the lifetime of the scope as one span
+class ScopedTimer{
+private:
+  std::string mName;
+  const char* mCategory;
+  int64_t mStart;
+
+public:
+  ScopedTimer(const char* category, std::string name): mName(std::move(name)), mCategory(category), mStart(Profiler::Get().Now()){}
+  ~ScopedTimer(){Profiler::Get().Record(std::move(mName), mCategory, mStart, Profiler::Get().Now());}
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+class ThreadPool{
+private:
+  std::vector<std::thread> mWorkers;
+  std::deque<std::function<void()>> mTasks;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mStop;
+
+  void WorkerLoop(){
+    for(;;){
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [this]{return mStop || !mTasks.empty();});
+        if(mStop && mTasks.empty()) return;
+        task = std::move(mTasks.front());
+        mTasks.pop_front();
+      }
+      task();
+    }
+  }
+
+public:
+  ThreadPool(size_t count): mStop(false){
+    for(size_t i = 0; i < count; i++)
+      mWorkers.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+
+  ~ThreadPool(){
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStop = true;
+    }
+    mCondition.notify_all();
+    for(auto& worker: mWorkers)
+      worker.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template <typename F>
+  auto Submit(F&& func) -> std::future<decltype(func())>{
+    using R = decltype(func());
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+    std::future<R> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mTasks.emplace_back([task]{(*task)();});
+    }
+    mCondition.notify_one();
+    return result;
+  }
+
+  size_t Size() const {return mWorkers.size();}
+
+  // runs fn(i) for every i in [0, count) on the pool and the calling thread. the caller waits for the
+  // items rather than for the queued helpers, so this is safe to call from inside a pool task
+  void ParallelFor(size_t count, const std::function<void(size_t)>& fn){
+    if(count == 0) return;
+    if(count == 1 || mWorkers.empty()){
+      for(size_t i = 0; i < count; i++) fn(i);
+      return;
+    }
+
+    struct State{
+      std::atomic<size_t> next{0};
+      std::atomic<size_t> done{0};
+      size_t count;
+      const std::function<void(size_t)>* fn;
+      std::mutex mutex;
+      std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->fn = &fn;
+
+    // helpers that start after the last item was claimed return without touching fn
+    auto work = [state]{
+      for(;;){
+        const size_t i = state->next++;
+        if(i >= state->count) return;
+        (*state->fn)(i);
+        if(++state->done == state->count){
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->finished.notify_all();
+        }
+      }
+    };
+
+    const size_t helpers = std::min(mWorkers.size(), count - 1);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      for(size_t i = 0; i < helpers; i++) mTasks.emplace_back(work);
+    }
+    mCondition.notify_all();
+
+    work();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&]{return state->done == state->count;});
+  }
+
+  // process-wide pool, leaves one core for the thread that owns the GL context
+  static ThreadPool& Get(){
+    static const unsigned int cores = std::thread::hardware_concurrency();
+    static ThreadPool pool(cores > 1? cores - 1 : 1);
+    return pool;
+  }
 };
 
-class VAO{
-private:
-  unsigned int mId;
+bool HasGLExtension(const char* name);
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// FNV-1a of a uniform name. constexpr, so names spelled out in code hash at compile time
+constexpr uint64_t UniformHash(const char* name){
+  uint64_t hash = 14695981039346656037ull;
+  for(; *name; name++) hash = (hash ^ (unsigned char)*name) * 1099511628211ull;
+  return hash;
+}
+
+// a uniform looked up by hash in the program's reflected table, no string is built or passed to GL
+struct UniformName{
+  uint64_t hash;
+  constexpr UniformName(const char* name): hash(UniformHash(name)){}
+  UniformName(const std::string& name): hash(UniformHash(name.c_str())){}
+};
+
+constexpr UniformName UNIFORM_MODEL("model");
+constexpr UniformName UNIFORM_VIEW("view");
+constexpr UniformName UNIFORM_PROJECTION("projection");
+
+// fixed texture units per material map, so sampler uniforms are set once at link time and draws only
+// bind textures. up to four numbered maps per type (texture_diffuse1..4)
+const unsigned int TEXTURE_UNITS_PER_TYPE = 4;
+
+int TextureUnit(const std::string& type, unsigned int number){
+  if(number < 1 || number > TEXTURE_UNITS_PER_TYPE) return -1;
+  int base;
+  if(type == "texture_diffuse") base = 0;
+  else if(type == "texture_specular") base = 1;
+  else if(type == "texture_normal") base = 2;
+  else if(type == "texture_orm") base = 3;
+  else return -1;
+  return base * TEXTURE_UNITS_PER_TYPE + number - 1;
+}
+
+// uploads and parameter changes bind here, so they leave the units draws sample from alone
+const unsigned int TEXTURE_UPLOAD_UNIT = 31;
+
+// texture arrays of the TextureArrayPool sit on units above the per-map ones, read by the shader as
+// sampler2DArray textureArrays[MAX_TEXTURE_ARRAYS]
+const unsigned int TEXTURE_ARRAY_UNIT = 16;
+const unsigned int MAX_TEXTURE_ARRAYS = 8;
+
+// shader storage binding of the MaterialTable's Materials block
+const unsigned int MATERIAL_BUFFER_BINDING = 2;
+
+// std140 mirrors of the uniform blocks shaders may declare. the static_asserts pin the C++ side to the
+// std140 offsets, Shader::Reflect checks each linked program's block against the same table
+struct FrameUniforms{
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec4 cameraPosition; // w unused
+};
+static_assert(offsetof(FrameUniforms, view) == 0 && offsetof(FrameUniforms, projection) == 64 &&
+              offsetof(FrameUniforms, cameraPosition) == 128 && sizeof(FrameUniforms) == 144, "FrameUniforms must follow std140");
+
+struct ObjectUniforms{
+  glm::mat4 model;
+};
+static_assert(offsetof(ObjectUniforms, model) == 0 && sizeof(ObjectUniforms) == 64, "ObjectUniforms must follow std140");
+
+struct UniformBlockLayout{
+  const char* name;
+  unsigned int binding;
+  size_t size;
+  std::vector<std::pair<const char*, size_t>> members;
+};
+
+const UniformBlockLayout UNIFORM_BLOCKS[] = {
+  {"Frame", 0, sizeof(FrameUniforms), {{"view", offsetof(FrameUniforms, view)}, {"projection", offsetof(FrameUniforms, projection)},
+                                       {"cameraPosition", offsetof(FrameUniforms, cameraPosition)}}},
+  {"Object", 1, sizeof(ObjectUniforms), {{"model", offsetof(ObjectUniforms, model)}}},
+};
+
+// mirror of the context's bindings and fixed-function state, so wrappers can skip calls that would
+// not change anything. everything that binds or toggles state goes through here, calls made around it
+// would leave the mirror stale. unknown entries are always issued. GL thread only
+class GLState{
+public:
+  enum Kind{PROGRAM, VERTEX_ARRAY, BUFFER, TEXTURE, FIXED, KIND_COUNT};
+
+  struct Counters{
+    size_t issued[KIND_COUNT] = {};
+    size_t filtered[KIND_COUNT] = {};
+  };
+
+private:
+  static constexpr unsigned int UNKNOWN = ~0u;
+  static constexpr unsigned int TRACKED_UNITS = 32;
+
+  unsigned int mProgram = UNKNOWN;
+  unsigned int mVertexArray = UNKNOWN;
+  // generic binding per buffer target, the element array one belongs to the bound VAO
+  std::vector<std::pair<GLenum, unsigned int>> mBuffers;
+  std::unordered_map<uint64_t, unsigned int> mIndexedBuffers;
+  unsigned int mActiveUnit = UNKNOWN;
+  // GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY per unit, other targets are not filtered
+  unsigned int mTextures[TRACKED_UNITS][2];
+  std::vector<std::pair<GLenum, int>> mFixed;
+
+  Counters mFrame;
+  Counters mLastFrame;
+  Counters mTotal;
+  size_t mFrames = 0;
+
+  GLState(){
+    for(auto& unit: mTextures) unit[0] = unit[1] = UNKNOWN;
+  }
+
+  // true when the call is needed, value becomes the mirrored one
+  template <typename T>
+  bool Change(Kind kind, T& current, T value){
+    if(current == value){
+      mFrame.filtered[kind]++;
+      return false;
+    }
+    current = value;
+    mFrame.issued[kind]++;
+    return true;
+  }
+
+  unsigned int& BufferSlot(GLenum target){
+    for(auto& buffer: mBuffers)
+      if(buffer.first == target) return buffer.second;
+    mBuffers.emplace_back(target, UNKNOWN);
+    return mBuffers.back().second;
+  }
+
+  int& FixedSlot(GLenum name){
+    for(auto& state: mFixed)
+      if(state.first == name) return state.second;
+    mFixed.emplace_back(name, (int)UNKNOWN);
+    return mFixed.back().second;
+  }
+
+  static int TextureSlot(GLenum target){
+    return target == GL_TEXTURE_2D? 0 : target == GL_TEXTURE_2D_ARRAY? 1 : -1;
+  }
+
+  // counts once per call, issued when it switches the active unit or binds. activate leaves unit
+  // active even when the texture is already bound there
+  void BindUnit(unsigned int unit, GLenum target, unsigned int id, bool activate){
+    const int slot = TextureSlot(target);
+    const bool bound = unit < TRACKED_UNITS && slot >= 0 && mTextures[unit][slot] == id;
+    if(bound && (!activate || mActiveUnit == unit)){
+      mFrame.filtered[TEXTURE]++;
+      return;
+    }
+    mFrame.issued[TEXTURE]++;
+    if(mActiveUnit != unit){
+      mActiveUnit = unit;
+      glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    if(bound) return;
+    glBindTexture(target, id);
+    if(unit < TRACKED_UNITS && slot >= 0) mTextures[unit][slot] = id;
+  }
+
+public:
+  static GLState& Get(){
+    static GLState state;
+    return state;
+  }
+
+  void UseProgram(unsigned int id){
+    if(Change(PROGRAM, mProgram, id)) glUseProgram(id);
+  }
+
+  void BindVertexArray(unsigned int id){
+    if(!Change(VERTEX_ARRAY, mVertexArray, id)) return;
+    glBindVertexArray(id);
+    BufferSlot(GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+  }
+
+  void BindBuffer(GLenum target, unsigned int id){
+    if(Change(BUFFER, BufferSlot(target), id)) glBindBuffer(target, id);
+  }
+
+  // also replaces the target's generic binding, as GL does
+  void BindBufferBase(GLenum target, unsigned int index, unsigned int id){
+    unsigned int& slot = mIndexedBuffers.emplace(((uint64_t)target << 32) | index, UNKNOWN).first->second;
+    if(!Change(BUFFER, slot, id)) return;
+    glBindBufferBase(target, index, id);
+    BufferSlot(target) = id;
+  }
+
+  // unit is an index, not a GL_TEXTURE0 enum
+  void BindTexture(unsigned int unit, GLenum target, unsigned int id){
+    BindUnit(unit, target, id, false);
+  }
+
+  // binds on TEXTURE_UPLOAD_UNIT and leaves it active, for the calls that act on the bound texture
+  void BindTextureForUpdate(GLenum target, unsigned int id){
+    BindUnit(TEXTURE_UPLOAD_UNIT, target, id, true);
+  }
+
+  void SetEnabled(GLenum capability, bool enabled){
+    if(!Change(FIXED, FixedSlot(capability), (int)enabled)) return;
+    if(enabled) glEnable(capability);
+    else glDisable(capability);
+  }
+
+  void DepthMask(bool write){
+    if(Change(FIXED, FixedSlot(GL_DEPTH_WRITEMASK), (int)write)) glDepthMask(write? GL_TRUE : GL_FALSE);
+  }
+
+  void BlendFunc(GLenum source, GLenum destination){
+    const bool changed = Change(FIXED, FixedSlot(GL_BLEND_SRC_ALPHA), (int)source);
+    if(Change(FIXED, FixedSlot(GL_BLEND_DST_ALPHA), (int)destination) || changed) glBlendFunc(source, destination);
+  }
+
+  void PixelStore(GLenum name, int value){
+    if(Change(FIXED, FixedSlot(name), value)) glPixelStorei(name, value);
+  }
+
+  // deleted names are unbound by GL and may be handed out again, so the mirror lets go of them
+  void DeleteProgram(unsigned int id){
+    if(!id) return;
+    glDeleteProgram(id);
+    if(mProgram == id) mProgram = UNKNOWN;
+  }
+
+  void DeleteVertexArray(unsigned int id){
+    if(!id) return;
+    glDeleteVertexArrays(1, &id);
+    if(mVertexArray == id){
+      mVertexArray = 0;
+      BufferSlot(GL_ELEMENT_ARRAY_BUFFER) = UNKNOWN;
+    }
+  }
+
+  void DeleteBuffer(unsigned int id){
+    if(!id) return;
+    glDeleteBuffers(1, &id);
+    for(auto& buffer: mBuffers)
+      if(buffer.second == id) buffer.second = 0;
+    for(auto& buffer: mIndexedBuffers)
+      if(buffer.second == id) buffer.second = 0;
+  }
+
+  void DeleteTexture(unsigned int id){
+    if(!id) return;
+    glDeleteTextures(1, &id);
+    for(auto& unit: mTextures)
+      for(unsigned int& texture: unit)
+        if(texture == id) texture = 0;
+  }
+
+  // once per frame after the swap
+  void EndFrame(){
+    for(int k = 0; k < KIND_COUNT; k++){
+      mTotal.issued[k] += mFrame.issued[k];
+      mTotal.filtered[k] += mFrame.filtered[k];
+    }
+    mLastFrame = mFrame;
+    mFrame = Counters();
+    mFrames++;
+  }
+
+  const Counters& GetLastFrame() const {return mLastFrame;}
+
+  void WriteSummary(std::ostream& out) const{
+    static const char* names[KIND_COUNT] = {"program", "vertex array", "buffer", "texture", "fixed function"};
+    if(!mFrames) return;
+    out<<"GL state calls per frame (issued/filtered) over "<<mFrames<<" frames:"<<std::endl;
+    for(int k = 0; k < KIND_COUNT; k++)
+      out<<"  "<<names[k]<<": "<<(double)mTotal.issued[k] / mFrames<<"/"<<(double)mTotal.filtered[k] / mFrames<<std::endl;
+  }
+};
+
+// storage for one block, bound once to the binding point its layout names
+template <typename T>
+class UniformBuffer{
+private:
+  unsigned int mId;
+
+public:
+  explicit UniformBuffer(unsigned int binding){
+    glGenBuffers(1, &mId);
+    GLState::Get().BindBuffer(GL_UNIFORM_BUFFER, mId);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+    GLState::Get().BindBufferBase(GL_UNIFORM_BUFFER, binding, mId);
+  }
+  ~UniformBuffer(){GLState::Get().DeleteBuffer(mId);}
+
+  UniformBuffer(const UniformBuffer&) = delete;
+  UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+  void Update(const T& data){
+    GLState::Get().BindBuffer(GL_UNIFORM_BUFFER, mId);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+  }
+};
+
+// linked program binaries, one file per vertex/fragment pair next to the vertex shader:
+//   ProgramCacheHeader, then size bytes of driver binary in binaryFormat
+const char PROGRAM_CACHE_MAGIC[4] = {'P','B','R','S'};
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader{
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t binaryFormat;
+  uint32_t size;
+};
+
+class Shader{
+  friend class ShaderBatch;
+
+private:
+  enum class State{Building, Ready, Failed};
+
+  unsigned int mId;
+  State mState;
+  // shader objects of a link in flight
+  unsigned int mVert;
+  unsigned int mFrag;
+  std::string mName;
+  std::string mCachePath;
+  uint64_t mKey;
+  bool mBinaryCache;
+  int64_t mSubmitted;
+  // locations of the program's default-block uniforms by UniformHash of their name
+  std::unordered_map<uint64_t, int> mLocations;
+
+  // binaries are only valid for the driver that produced them, so its identity is part of the key
+  static uint64_t ProgramKey(const std::string& vCode, const std::string& fCode){
+    uint64_t key = HashBytes(vCode.data(), vCode.size());
+    key = HashBytes(fCode.data(), fCode.size(), key);
+    for(GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}){
+      const char* str = reinterpret_cast<const char*>(glGetString(name));
+      if(str) key = HashBytes(str, strlen(str), key);
+    }
+    return key;
+  }
+
+  static std::string ProgramCachePath(const std::string& vertPath, const std::string& fragPath){
+    const std::string pair = vertPath + "|" + fragPath;
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%08x.glbin", (uint32_t)HashBytes(pair.data(), pair.size()));
+    return vertPath + suffix;
+  }
+
+  // false when the file is missing or stale, or the driver rejects the binary after an update
+  bool LoadProgramBinary(const std::string& path, uint64_t key){
+    MappedFile file;
+    if(!file.Open(path)) return false;
+
+    BinaryReader reader(file.Data(), file.Size());
+    ProgramCacheHeader header;
+    if(!reader.Read(header)) return false;
+    if(memcmp(header.magic, PROGRAM_CACHE_MAGIC, 4) != 0 || header.version != PROGRAM_CACHE_VERSION || header.key != key) return false;
+    const unsigned char* binary = reader.Skip(header.size);
+    if(!binary) return false;
+
+    mId = glCreateProgram();
+    glProgramBinary(mId, header.binaryFormat, binary, header.size);
+    int success;
+    glGetProgramiv(mId, GL_LINK_STATUS, &success);
+    if(!success){
+      GLState::Get().DeleteProgram(mId);
+      mId = 0;
+      return false;
+    }
+    return true;
+  }
+
+  void SaveProgramBinary(const std::string& path, uint64_t key){
+    int size = 0;
+    glGetProgramiv(mId, GL_PROGRAM_BINARY_LENGTH, &size);
+    if(size <= 0) return;
+
+    std::vector<unsigned char> binary(size);
+    GLenum format = 0;
+    glGetProgramBinary(mId, size, &size, &format, binary.data());
+
+    BinaryWriter writer;
+    ProgramCacheHeader header = {};
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, 4);
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.binaryFormat = format;
+    header.size = size;
+    writer.Write(header);
+    writer.Write(binary.data(), size);
+    if(!writer.SaveToFile(path))
+      std::cerr<<"WARNING: writing program cache -> "<<path<<std::endl;
+  }
+
+  // through MappedFile so shaders can come from a mounted archive
+  static std::string LoadFile(const std::string& path){
+    MappedFile file;
+    if(!file.Open(path)){
+      std::cerr<<"ERROR: opening shader -> "<<path<<std::endl;
+      exit(1);
+    }
+    return std::string(reinterpret_cast<const char*>(file.Data()), file.Size());
+  }
+
+  // only queues the compile, the status is read in Finish so the driver can overlap the work
+  static unsigned int SubmitShader(const std::string& srcCode, bool isVert){
+    const char* code = srcCode.c_str();
+    unsigned int shader = isVert? glCreateShader(GL_VERTEX_SHADER) : glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(shader, 1, &code, nullptr);
+    glCompileShader(shader);
+    return shader;
+  }
+
+  static bool CheckShader(unsigned int shader, bool isVert, const std::string& name){
+    int success;
+    char infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if(success) return true;
+    glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+    std::cerr<<"ERROR: compiling "<<name<<(isVert?" vertex":" fragment")<<" shader -> "<<infoLog<<std::endl;
+    return false;
+  }
+
+  // runs once the program is linked: records every uniform location, points material samplers at
+  // their TextureUnit and binds known blocks to their UNIFORM_BLOCKS binding after checking the layout
+  void Reflect(){
+    mLocations.clear();
+    int count = 0;
+    int maxLength = 0;
+    glGetProgramiv(mId, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(mId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> buffer(std::max(maxLength, 1));
+    for(int i = 0; i < count; i++){
+      int size;
+      GLenum type;
+      GLsizei length;
+      glGetActiveUniform(mId, i, buffer.size(), &length, &size, &type, buffer.data());
+      std::string name(buffer.data(), length);
+      // block members have no location
+      const int location = glGetUniformLocation(mId, name.c_str());
+      if(location < 0) continue;
+      // arrays are reported as name[0], address them by name
+      if(name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) name.resize(name.size() - 3);
+      mLocations[UniformHash(name.c_str())] = location;
+
+      if(name == "textureArrays"){
+        std::vector<int> units(std::min(size, (int)MAX_TEXTURE_ARRAYS));
+        for(size_t u = 0; u < units.size(); u++) units[u] = TEXTURE_ARRAY_UNIT + u;
+        glProgramUniform1iv(mId, location, units.size(), units.data());
+        continue;
+      }
+
+      const std::string prefix = "material.";
+      if(name.compare(0, prefix.size(), prefix) != 0) continue;
+      size_t digits = name.size();
+      while(digits > prefix.size() && isdigit((unsigned char)name[digits - 1])) digits--;
+      const unsigned int number = (digits < name.size())? atoi(name.c_str() + digits) : 1;
+      const int unit = TextureUnit(name.substr(prefix.size(), digits - prefix.size()), number);
+      if(unit >= 0) glProgramUniform1i(mId, location, unit);
+    }
+
+    int blocks = 0;
+    glGetProgramiv(mId, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+    for(int b = 0; b < blocks; b++){
+      char blockName[128];
+      glGetActiveUniformBlockName(mId, b, sizeof(blockName), nullptr, blockName);
+      const UniformBlockLayout* layout = nullptr;
+      for(auto& known: UNIFORM_BLOCKS)
+        if(strcmp(known.name, blockName) == 0) layout = &known;
+      if(!layout){
+        std::cerr<<"WARNING: shader program "<<mName<<" declares unknown uniform block "<<blockName<<std::endl;
+        continue;
+      }
+      glUniformBlockBinding(mId, b, layout->binding);
+
+      int dataSize = 0;
+      glGetActiveUniformBlockiv(mId, b, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+      bool matches = (size_t)dataSize == layout->size;
+      for(auto& member: layout->members){
+        // members of blocks with an instance name are reported as Block.member
+        const std::string qualified = std::string(blockName) + "." + member.first;
+        const char* names[2] = {member.first, qualified.c_str()};
+        GLuint indices[2];
+        glGetUniformIndices(mId, 2, names, indices);
+        const GLuint index = (indices[0] != GL_INVALID_INDEX)? indices[0] : indices[1];
+        if(index == GL_INVALID_INDEX) continue;
+        int offset = -1;
+        glGetActiveUniformsiv(mId, 1, &index, GL_UNIFORM_OFFSET, &offset);
+        matches = matches && (size_t)offset == member.second;
+      }
+      if(!matches) std::cerr<<"WARNING: uniform block "<<blockName<<" in "<<mName<<" does not match its std140 struct"<<std::endl;
+    }
+
+    const GLuint materials = glGetProgramResourceIndex(mId, GL_SHADER_STORAGE_BLOCK, "Materials");
+    if(materials != GL_INVALID_INDEX) glShaderStorageBlockBinding(mId, materials, MATERIAL_BUFFER_BINDING);
+  }
+
+  // reads back the compile and link results of the queued build. this blocks until the driver is
+  // done, Poll only calls it once GL_COMPLETION_STATUS_KHR says it will not
+  void Finish(bool fatal){
+    if(mState != State::Building) return;
+
+    bool success = CheckShader(mVert, true, mName) & CheckShader(mFrag, false, mName);
+    if(success){
+      int linked;
+      char infoLog[512];
+      glGetProgramiv(mId, GL_LINK_STATUS, &linked);
+      if(!linked){
+        glGetProgramInfoLog(mId, 512, nullptr, infoLog);
+        std::cerr<<"ERROR: linking shader program "<<mName<<" -> "<<infoLog<<std::endl;
+        success = false;
+      }
+    }
+
+    glDeleteShader(mVert);
+    glDeleteShader(mFrag);
+    mVert = mFrag = 0;
+    Profiler::Get().Record("build " + mName, "shader", mSubmitted, Profiler::Get().Now());
+
+    if(!success){
+      if(fatal) exit(1);
+      GLState::Get().DeleteProgram(mId);
+      mId = 0;
+      mState = State::Failed;
+      return;
+    }
+
+    if(mBinaryCache) SaveProgramBinary(mCachePath, mKey);
+    Reflect();
+    mState = State::Ready;
+    std::cout<<"Successfully created shader program!"<<std::endl;
+  }
+
+public:
+  // true when the driver compiles and links on its own threads (GL_KHR_parallel_shader_compile),
+  // in which case builds can be queued together and polled without stalling the frame
+  static bool ParallelCompile(){
+    static const bool supported = HasGLExtension("GL_KHR_parallel_shader_compile") || HasGLExtension("GL_ARB_parallel_shader_compile");
+    return supported;
+  }
+
+  // blocking, exits when the program does not build
+  Shader(const std::string& vertPath, const std::string& fragPath): Shader(vertPath, LoadFile(vertPath), fragPath, LoadFile(fragPath)){
+    Finish(true);
+  }
+
+  // links from the program cache when the driver accepts it, otherwise queues compile and link from
+  // source and returns, the result is cached once Poll sees the build finish. the paths name the
+  // program in logs and place its cache file
+  Shader(const std::string& vertPath, const std::string& vCode, const std::string& fragPath, const std::string& fCode):
+    mId(0), mState(State::Building), mVert(0), mFrag(0), mName(vertPath + " + " + fragPath){
+    int binaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    mBinaryCache = binaryFormats > 0;
+    mKey = ProgramKey(vCode, fCode);
+    mCachePath = ProgramCachePath(vertPath, fragPath);
+    if(mBinaryCache){
+      ScopedTimer timer("shader", "load binary " + mCachePath);
+      if(LoadProgramBinary(mCachePath, mKey)){
+        Reflect();
+        mState = State::Ready;
+        return;
+      }
+    }
+
+    mSubmitted = Profiler::Get().Now();
+    mVert = SubmitShader(vCode, true);
+    mFrag = SubmitShader(fCode, false);
+    mId = glCreateProgram();
+    glAttachShader(mId, mVert);
+    glAttachShader(mId, mFrag);
+    glProgramParameteri(mId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(mId);
+  }
+
+  Shader(const Shader&) = delete;
+  Shader& operator=(const Shader&) = delete;
+
+  // finishes the build if the driver is done with it, never waits when ParallelCompile is available.
+  // without it the status query blocks, so callers spread those over frames. true once settled
+  bool Poll(){
+    if(mState != State::Building) return true;
+    if(ParallelCompile()){
+      int done = 0;
+      glGetProgramiv(mId, GL_COMPLETION_STATUS_KHR, &done);
+      if(!done) return false;
+    }
+    Finish(false);
+    return true;
+  }
+
+  // blocks until the build settles
+  void Wait() {Finish(false);}
+
+  bool IsReady() const {return mState == State::Ready;}
+  bool IsFailed() const {return mState == State::Failed;}
+
+  ~Shader(){
+    if(mVert) glDeleteShader(mVert);
+    if(mFrag) glDeleteShader(mFrag);
+    GLState::Get().DeleteProgram(mId);
+  }
+
+  void Use() {GLState::Get().UseProgram(mId);}
+
+  // uniforms the program does not use are skipped without a GL call
+  template <typename T>
+  void SetValue(UniformName name, const T& val){
+    auto it = mLocations.find(name.hash);
+    if(it == mLocations.end()) return;
+    const int loc = it->second;
+
+    if constexpr(std::is_same_v<T,int>) glUniform1i(loc, val);
+    else if constexpr(std::is_same_v<T,unsigned int>) glUniform1i(loc, (int)val);
+    else if constexpr(std::is_same_v<T,bool>) glUniform1i(loc, (int)val);
+    else if constexpr(std::is_same_v<T,float>) glUniform1f(loc, val);
+    else if constexpr(std::is_same_v<T,glm::vec2>) glUniform2fv(loc, 1, glm::value_ptr(val));
+    else if constexpr(std::is_same_v<T,glm::vec3>) glUniform3fv(loc, 1, glm::value_ptr(val));
+    else if constexpr(std::is_same_v<T,glm::mat4>) glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(val));
+  }
+};
+
+// stands in for programs that are still building, plain lambert shading of the mesh layout
+const char* FALLBACK_VERTEX_SHADER = R"(#version 460 core
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 3) in vec3 aPositionScale;
+layout(location = 4) in vec3 aPositionOffset;
+layout(location = 5) in uint aOctNormals;
+layout(std140, binding = 0) uniform Frame{
+  mat4 view;
+  mat4 projection;
+  vec4 cameraPosition;
+};
+layout(std140, binding = 1) uniform Object{
+  mat4 model;
+};
+out vec3 normal;
+vec3 OctDecode(vec2 e){
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0? -t : t, n.y >= 0.0? -t : t);
+  return normalize(n);
+}
+void main(){
+  normal = mat3(model) * ((aOctNormals != 0u)? OctDecode(aNormal.xy) : aNormal);
+  gl_Position = projection * view * model * vec4(aPosition * aPositionScale + aPositionOffset, 1.0);
+}
+)";
+
+const char* FALLBACK_FRAGMENT_SHADER = R"(#version 460 core
+in vec3 normal;
+out vec4 color;
+void main(){
+  color = vec4(vec3(0.2 + 0.6 * max(dot(normalize(normal), normalize(vec3(0.4, 1.0, 0.6))), 0.0)), 1.0);
+}
+)";
+
+// builds many programs at once: Add queues every compile and link up front, the driver runs them in
+// parallel where GL_KHR_parallel_shader_compile allows, and Poll settles finished ones once a frame.
+// Select hands out the fallback program until a shader is ready
+class ShaderBatch{
+private:
+  typedef void (APIENTRY* MaxShaderCompilerThreadsProc)(GLuint count);
+
+  std::vector<std::shared_ptr<Shader>> mPending;
+  std::unique_ptr<Shader> mFallback;
+
+public:
+  ShaderBatch(){
+    if(Shader::ParallelCompile()){
+      auto maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+      if(!maxThreads) maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+      // let the driver pick how many threads to use
+      if(maxThreads) maxThreads(0xFFFFFFFF);
+    }
+    mFallback = std::make_unique<Shader>("fallback.vert", FALLBACK_VERTEX_SHADER, "fallback.frag", FALLBACK_FRAGMENT_SHADER);
+    mFallback->Wait();
+  }
+
+  std::shared_ptr<Shader> Add(const std::string& vertPath, const std::string& fragPath){
+    auto shader = std::make_shared<Shader>(vertPath, Shader::LoadFile(vertPath), fragPath, Shader::LoadFile(fragPath));
+    if(!shader->IsReady()) mPending.push_back(shader);
+    return shader;
+  }
+
+  // without parallel compile each finished build blocks, so at most one is settled per call
+  void Poll(){
+    const bool parallel = Shader::ParallelCompile();
+    for(size_t i = 0; i < mPending.size();){
+      if(!mPending[i]->Poll()){
+        i++;
+        continue;
+      }
+      mPending.erase(mPending.begin() + i);
+      if(!parallel) break;
+    }
+  }
+
+  bool IsDone() const {return mPending.empty();}
+
+  Shader& Select(const std::shared_ptr<Shader>& shader){return shader->IsReady()? *shader : *mFallback;}
+};
+
+class VBO{
+private:
+  unsigned int mId;
+
+public:
+  VBO(){glGenBuffers(1, &mId);}
+  ~VBO(){GLState::Get().DeleteBuffer(mId);}
+
+  VBO(const VBO&) = delete;
+  VBO(VBO&& other) noexcept : mId(other.mId){other.mId = 0;}
+  VBO& operator=(VBO&& other) noexcept{
+    if(this != &other){
+      GLState::Get().DeleteBuffer(mId);
+      mId = other.mId;
+      other.mId = 0;
+    }
+    return *this;
+  }
+
+  void Bind(){GLState::Get().BindBuffer(GL_ARRAY_BUFFER, mId);}
+  void Unbind(){GLState::Get().BindBuffer(GL_ARRAY_BUFFER, 0);}
+  unsigned int GetId() const {return mId;}
+
+  void AllocateMem(size_t size, GLenum usage){glBufferData(GL_ARRAY_BUFFER, size, nullptr, usage);}
+  void FillMem(size_t offset, size_t size, const void* data){glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);}
+  void AllocateAndFillMem(size_t size, const void* data, GLenum usage){glBufferData(GL_ARRAY_BUFFER, size, data, usage);}
+};
+
+class EBO{
+private:
+  unsigned int mId;
+
+public:
+  EBO(){glGenBuffers(1, &mId);}
+  ~EBO(){GLState::Get().DeleteBuffer(mId);}
+
+  EBO(const EBO&) = delete;
+  EBO(EBO&& other) noexcept : mId(other.mId){other.mId = 0;}
+  EBO& operator=(EBO&& other) noexcept{
+    if(this != &other){
+      GLState::Get().DeleteBuffer(mId);
+      mId = other.mId;
+      other.mId = 0;
+    }
+    return *this;
+  }
+
+  void Bind(){GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mId);}
+  void Unbind(){GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);}
+  unsigned int GetId() const {return mId;}
+
+  void AllocateMem(size_t size, GLenum usage){glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, nullptr, usage);}
+  void FillMem(size_t offset, size_t size, const void* data){glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, size, data);}
+  void AllocateAndFillMem(size_t size, const void* data, GLenum usage){glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, usage);}
+};
+
+class VAO{
+private:
+  unsigned int mId;
+
+public:
+  VAO(){glGenVertexArrays(1, &mId);}
+  ~VAO(){GLState::Get().DeleteVertexArray(mId);}
+
+  VAO(const VAO&) = delete;
+  VAO(VAO&& other) noexcept : mId(other.mId){other.mId = 0;}
+  VAO& operator=(VAO&& other) noexcept{
+    if(this != &other){
+      GLState::Get().DeleteVertexArray(mId);
+      mId = other.mId;
+      other.mId = 0;
+    }
+    return *this;
+  }
+
+  void Bind(){GLState::Get().BindVertexArray(mId);}
+  void Unbind(){GLState::Get().BindVertexArray(0);}
+
+  void SetAttrib(int loc, int nr, size_t stride, size_t offset, GLenum type = GL_FLOAT, bool normalized = false){
+    glEnableVertexAttribArray(loc);
+    glVertexAttribPointer(loc, nr, type, normalized? GL_TRUE : GL_FALSE, stride, (void*)offset);
+  }
+
+  // integer attributes reach the shader unconverted, as int/uint inputs
+  void SetIntAttrib(int loc, int nr, size_t stride, size_t offset, GLenum type = GL_UNSIGNED_INT){
+    glEnableVertexAttribArray(loc);
+    glVertexAttribIPointer(loc, nr, type, stride, (void*)offset);
+  }
+};
+
+struct Vertex{
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 texcoord;
+};
+
+enum class VertexFormat : uint32_t{
+  Float,  // Vertex, 32 bytes
+  Packed  // PackedVertex, 16 bytes
+};
+
+// position as 16-bit unorm inside the mesh bounds (dequantized by positionScale/positionOffset
+// in the vertex shader), normal octahedral encoded as two snorm16 (decoded in the vertex shader when
+// octNormals is set), texcoord as two half floats. there are no tangents to pack, Vertex carries none
+struct PackedVertex{
+  uint16_t position[4];
+  uint32_t normal;
+  uint32_t texcoord;
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+inline size_t VertexStride(VertexFormat format){
+  return (format == VertexFormat::Packed)? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+// folds the unit sphere onto the [-1, 1] square, the lower hemisphere mirrored into the corners
+inline glm::vec2 OctEncode(const glm::vec3& n){
+  const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if(l1 == 0.0f) return glm::vec2(0.0f, 1.0f);
+  glm::vec2 e = glm::vec2(n) / l1;
+  if(n.z < 0.0f){
+    const glm::vec2 s(e.x >= 0.0f? 1.0f : -1.0f, e.y >= 0.0f? 1.0f : -1.0f);
+    e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * s;
+  }
+  return e;
+}
+
+PackedVertex PackVertex(const Vertex& v, const glm::vec3& boundsMin, const glm::vec3& invExtent){
+  PackedVertex p;
+  const glm::vec3 q = glm::clamp((v.position - boundsMin) * invExtent, 0.0f, 1.0f) * 65535.0f + 0.5f;
+  p.position[0] = (uint16_t)q.x;
+  p.position[1] = (uint16_t)q.y;
+  p.position[2] = (uint16_t)q.z;
+  p.position[3] = 0;
+  p.normal = glm::packSnorm2x16(OctEncode(v.normal));
+  p.texcoord = glm::packHalf2x16(v.texcoord);
+  return p;
+}
+
+// GL texture shared by every Texture that references the same image, deleted with the last reference
+class TextureResource{
+private:
+  unsigned int mId;
+  std::string mKey;
+  // layer of a TextureArrayPool array instead of a texture of its own, mId is 0 then
+  int mArray;
+  int mLayer;
+
+public:
+  TextureResource(const std::string& key, unsigned int id): mId(id), mKey(key), mArray(-1), mLayer(-1){}
+  TextureResource(const std::string& key, int array, int layer): mId(0), mKey(key), mArray(array), mLayer(layer){}
+  ~TextureResource();
+
+  TextureResource(const TextureResource&) = delete;
+  TextureResource& operator=(const TextureResource&) = delete;
+
+  unsigned int GetId() const {return mId;}
+  const std::string& GetKey() const {return mKey;}
+  int GetArray() const {return mArray;}
+  int GetLayer() const {return mLayer;}
+};
+
+// process-wide map from resolved path or content hash to the live GL texture
+class TextureCache{
+private:
+  std::mutex mMutex;
+  std::unordered_map<std::string, std::weak_ptr<TextureResource>> mEntries;
+
+public:
+  static TextureCache& Get(){
+    static TextureCache cache;
+    return cache;
+  }
+
+  std::shared_ptr<TextureResource> Find(const std::string& key){
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mEntries.find(key);
+    return (it != mEntries.end())? it->second.lock() : nullptr;
+  }
+
+  template <typename... Args>
+  std::shared_ptr<TextureResource> Insert(const std::string& key, Args... placement){
+    auto resource = std::make_shared<TextureResource>(key, placement...);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries[key] = resource;
+    return resource;
+  }
+
+  void Remove(const std::string& key){
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mEntries.find(key);
+    // a new resource may have been inserted under this key after the old one expired
+    if(it != mEntries.end() && it->second.expired()) mEntries.erase(it);
+  }
+
+  size_t Size(){
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mEntries.size();
+  }
+
+  static std::string KeyForFile(const std::string& path){
+    char* resolved = realpath(path.c_str(), nullptr);
+    if(!resolved) return "file:" + path;
+    std::string key = std::string("file:") + resolved;
+    free(resolved);
+    return key;
+  }
+
+  static std::string KeyForMemory(const void* data, size_t size, uint32_t width, uint32_t height){
+    char key[64];
+    snprintf(key, sizeof(key), "mem:%016llx:%ux%u", (unsigned long long)HashBytes(data, size), width, height);
+    return key;
+  }
+};
+
+struct Texture{
+  std::string type;
+  std::string path;
+  unsigned int id;
+  std::shared_ptr<TextureResource> resource;
+};
+
+// post-transform cache statistics from a FIFO simulation, ACMR is misses per triangle and ATVR misses per referenced vertex
+struct VertexCacheStats{
+  float acmr = 0.0f;
+  float atvr = 0.0f;
+};
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, size_t cacheSize = 16){
+  VertexCacheStats stats;
+  if(indices.empty()) return stats;
+
+  std::vector<unsigned int> timestamps(vertexCount, 0);
+  std::vector<bool> referenced(vertexCount, false);
+  unsigned int time = cacheSize + 1;
+  size_t misses = 0;
+  size_t unique = 0;
+
+  for(unsigned int index: indices){
+    if(!referenced[index]){
+      referenced[index] = true;
+      unique++;
+    }
+    if(time - timestamps[index] > cacheSize){
+      timestamps[index] = time++;
+      misses++;
+    }
+  }
+
+  stats.acmr = (float)misses / (indices.size() / 3);
+  stats.atvr = (float)misses / unique;
+  return stats;
+}
+
+// Forsyth's linear-speed vertex cache optimization, greedily emits the triangle whose vertices
+// score highest for being recently used and having few remaining triangles
+void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount){
+  const int kCacheSize = 32;
+  const size_t triCount = indices.size() / 3;
+  if(triCount == 0) return;
+
+  auto vertexScore = [kCacheSize](int cachePos, unsigned int remaining){
+    if(remaining == 0) return -1.0f;
+    float score = 0.0f;
+    if(cachePos >= 0){
+      if(cachePos < 3) score = 0.75f;
+      else score = std::pow(1.0f - (float)(cachePos - 3) / (kCacheSize - 3), 1.5f);
+    }
+    return score + 2.0f / std::sqrt((float)remaining);
+  };
+
+  // vertex -> triangle adjacency in CSR form, the live range shrinks as triangles are emitted
+  std::vector<unsigned int> remaining(vertexCount, 0);
+  for(unsigned int index: indices) remaining[index]++;
+  std::vector<unsigned int> offsets(vertexCount + 1, 0);
+  for(size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + remaining[v];
+  std::vector<unsigned int> adjacency(indices.size());
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  for(size_t t = 0; t < triCount; t++)
+    for(int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = t;
+
+  std::vector<float> vScore(vertexCount);
+  for(size_t v = 0; v < vertexCount; v++) vScore[v] = vertexScore(-1, remaining[v]);
+
+  std::vector<float> tScore(triCount);
+  std::vector<bool> emitted(triCount, false);
+  for(size_t t = 0; t < triCount; t++)
+    tScore[t] = vScore[indices[t * 3]] + vScore[indices[t * 3 + 1]] + vScore[indices[t * 3 + 2]];
+
+  std::vector<unsigned int> cache;
+  std::vector<unsigned int> nextCache;
+  std::vector<unsigned int> output;
+  output.reserve(indices.size());
+
+  long best = 0;
+  for(size_t t = 1; t < triCount; t++) if(tScore[t] > tScore[best]) best = t;
+  size_t scanStart = 0;
+
+  for(size_t emittedCount = 0; emittedCount < triCount; emittedCount++){
+    if(best < 0){
+      // nothing adjacent to the cache is left, fall back to the next unemitted triangle
+      while(emitted[scanStart]) scanStart++;
+      best = scanStart;
+    }
+
+    const unsigned int* tri = &indices[best * 3];
+    emitted[best] = true;
+    nextCache.assign(tri, tri + 3);
+
+    for(int k = 0; k < 3; k++){
+      const unsigned int v = tri[k];
+      output.push_back(v);
+      // move the emitted triangle out of the vertex's live adjacency range
+      unsigned int* begin = &adjacency[offsets[v]];
+      unsigned int* end = begin + remaining[v];
+      *std::find(begin, end, (unsigned int)best) = *(end - 1);
+      remaining[v]--;
+    }
+
+    for(unsigned int v: cache)
+      if(v != tri[0] && v != tri[1] && v != tri[2]) nextCache.push_back(v);
+    cache.swap(nextCache);
+
+    best = -1;
+    float bestScore = -1.0f;
+    for(size_t i = 0; i < cache.size(); i++){
+      const unsigned int v = cache[i];
+      const int pos = (i < (size_t)kCacheSize)? (int)i : -1;
+      const float score = vertexScore(pos, remaining[v]);
+      const float delta = score - vScore[v];
+      vScore[v] = score;
+
+      for(unsigned int j = 0; j < remaining[v]; j++){
+        const unsigned int t = adjacency[offsets[v] + j];
+        tScore[t] += delta;
+        if(tScore[t] > bestScore){
+          bestScore = tScore[t];
+          best = t;
+        }
+      }
+    }
+    if(cache.size() > (size_t)kCacheSize) cache.resize(kCacheSize);
+  }
+
+  indices.swap(output);
+}
+
+// splits the cache-optimized order into clusters at cache flushes and draws outward-facing clusters first,
+// so the depth test rejects more of the hidden fragments while keeping most of the cache locality
+void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices){
+  const size_t triCount = indices.size() / 3;
+  if(triCount < 2) return;
+
+  const size_t cacheSize = 16;
+  std::vector<unsigned int> timestamps(vertices.size(), 0);
+  unsigned int time = cacheSize + 1;
+  std::vector<size_t> clusterStarts;
+
+  for(size_t t = 0; t < triCount; t++){
+    int misses = 0;
+    for(int k = 0; k < 3; k++){
+      const unsigned int v = indices[t * 3 + k];
+      if(time - timestamps[v] > cacheSize){
+        timestamps[v] = time++;
+        misses++;
+      }
+    }
+    if(t == 0 || misses == 3) clusterStarts.push_back(t);
+  }
+  clusterStarts.push_back(triCount);
+
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  std::vector<glm::vec3> faceNormals(triCount);
+  std::vector<glm::vec3> faceCentroids(triCount);
+  for(size_t t = 0; t < triCount; t++){
+    const glm::vec3& a = vertices[indices[t * 3]].position;
+    const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+    const glm::vec3& c = vertices[indices[t * 3 + 2]].position;
+    faceNormals[t] = glm::cross(b - a, c - a);
+    faceCentroids[t] = (a + b + c) / 3.0f;
+    const float area = glm::length(faceNormals[t]);
+    meshCentroid += faceCentroids[t] * area;
+    meshArea += area;
+  }
+  if(meshArea > 0.0f) meshCentroid /= meshArea;
+
+  struct Cluster{
+    size_t start;
+    size_t end;
+    float sortKey;
+  };
+  std::vector<Cluster> clusters;
+  for(size_t c = 0; c + 1 < clusterStarts.size(); c++){
+    glm::vec3 centroid(0.0f);
+    glm::vec3 normal(0.0f);
+    float area = 0.0f;
+    for(size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++){
+      const float a = glm::length(faceNormals[t]);
+      centroid += faceCentroids[t] * a;
+      normal += faceNormals[t];
+      area += a;
+    }
+    if(area > 0.0f) centroid /= area;
+    const float len = glm::length(normal);
+    const float key = (len > 0.0f)? glm::dot(centroid - meshCentroid, normal / len) : 0.0f;
+    clusters.push_back({clusterStarts[c], clusterStarts[c + 1], key});
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b){return a.sortKey > b.sortKey;});
+
+  std::vector<unsigned int> output;
+  output.reserve(indices.size());
+  for(auto& cluster: clusters)
+    output.insert(output.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+  indices.swap(output);
+}
+
+// merges vertices with identical attributes, importers without JoinIdenticalVertices emit one vertex per face corner
+void WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices){
+  std::unordered_map<uint64_t, unsigned int> lookup;
+  lookup.reserve(vertices.size());
+  std::vector<unsigned int> remap(vertices.size());
+  std::vector<Vertex> output;
+  output.reserve(vertices.size());
+
+  for(size_t i = 0; i < vertices.size(); i++){
+    const uint64_t hash = HashBytes(&vertices[i], sizeof(Vertex));
+    auto it = lookup.find(hash);
+    if(it != lookup.end() && memcmp(&output[it->second], &vertices[i], sizeof(Vertex)) == 0){
+      remap[i] = it->second;
+      continue;
+    }
+    remap[i] = output.size();
+    if(it == lookup.end()) lookup[hash] = output.size();
+    output.push_back(vertices[i]);
+  }
+
+  for(unsigned int& index: indices) index = remap[index];
+  vertices.swap(output);
+}
+
+// plane distance quadric, the upper triangle of the symmetric 4x4 matrix
+struct Quadric{
+  double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+  void AddPlane(const glm::dvec3& n, double d){
+    a2 += n.x * n.x; ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+    b2 += n.y * n.y; bc += n.y * n.z; bd += n.y * d;
+    c2 += n.z * n.z; cd += n.z * d;
+    d2 += d * d;
+  }
+
+  void Add(const Quadric& q){
+    a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+    bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+  }
+
+  double Evaluate(const glm::vec3& p) const{
+    const double x = p.x, y = p.y, z = p.z;
+    const double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                   + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                   + c2 * z * z + 2 * cd * z + d2;
+    return e > 0.0? e : 0.0;
+  }
+};
+
+// quadric error metric simplification by half-edge collapse onto existing vertices, so every LOD can share
+// one vertex buffer. Vertices on open borders and on attribute seams (same position, different normal or
+// texcoord) never move, which keeps UV and shading discontinuities intact. Stops at targetIndexCount or
+// once the next collapse would move the surface by more than targetError, reports the error reached
+std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t targetIndexCount, float targetError, float& resultError){
+  const size_t vertexCount = vertices.size();
+  resultError = 0.0f;
+
+  // group vertices sharing a position, the first one of each group carries the quadric
+  struct PositionHash{
+    size_t operator()(const glm::vec3& p) const {return HashBytes(&p, sizeof(p));}
+  };
+  std::unordered_map<glm::vec3, unsigned int, PositionHash> positions;
+  std::vector<unsigned int> canonical(vertexCount);
+  std::vector<bool> locked(vertexCount, false);
+  for(size_t i = 0; i < vertexCount; i++){
+    auto it = positions.emplace(vertices[i].position, i).first;
+    canonical[i] = it->second;
+    if(it->second != i) locked[i] = locked[it->second] = true;
+  }
+
+  // edges used by a single triangle lie on an open border
+  std::unordered_map<uint64_t, int> edgeUse;
+  for(size_t t = 0; t < indices.size(); t += 3){
+    for(int k = 0; k < 3; k++){
+      uint64_t a = canonical[indices[t + k]];
+      uint64_t b = canonical[indices[t + (k + 1) % 3]];
+      if(a > b) std::swap(a, b);
+      edgeUse[(a << 32) | b]++;
+    }
+  }
+  for(auto& edge: edgeUse){
+    if(edge.second != 1) continue;
+    locked[edge.first >> 32] = true;
+    locked[edge.first & 0xFFFFFFFFu] = true;
+  }
+  for(size_t i = 0; i < vertexCount; i++)
+    if(locked[i]) locked[canonical[i]] = true;
+
+  std::vector<Quadric> quadrics(vertexCount);
+  for(size_t t = 0; t < indices.size(); t += 3){
+    const glm::dvec3 p0 = vertices[indices[t]].position;
+    const glm::dvec3 p1 = vertices[indices[t + 1]].position;
+    const glm::dvec3 p2 = vertices[indices[t + 2]].position;
+    glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+    const double len = glm::length(n);
+    if(len <= 0.0) continue;
+    n /= len;
+    const double d = -glm::dot(n, p0);
+    for(int k = 0; k < 3; k++) quadrics[canonical[indices[t + k]]].AddPlane(n, d);
+  }
+
+  struct Collapse{
+    unsigned int from;
+    unsigned int to;
+    double cost;
+  };
+
+  std::vector<unsigned int> result = indices;
+  std::vector<unsigned int> remap(vertexCount);
+  std::vector<unsigned int> offsets(vertexCount + 1);
+  std::vector<unsigned int> adjacency;
+  std::vector<Collapse> collapses;
+  std::vector<bool> touched(vertexCount);
+  const double maxCost = (double)targetError * targetError;
+
+  auto flips = [&](unsigned int from, unsigned int to){
+    const glm::vec3& target = vertices[to].position;
+    for(unsigned int j = offsets[from]; j < offsets[from + 1]; j++){
+      const unsigned int* tri = &result[adjacency[j] * 3];
+      if(tri[0] == to || tri[1] == to || tri[2] == to) continue;
+      glm::vec3 p[3];
+      glm::vec3 q[3];
+      for(int k = 0; k < 3; k++){
+        p[k] = vertices[tri[k]].position;
+        q[k] = (tri[k] == from)? target : p[k];
+      }
+      const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+      const glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+      if(glm::dot(before, after) <= 0.0f) return true;
+    }
+    return false;
+  };
+
+  while(result.size() > targetIndexCount){
+    // vertex -> triangle adjacency of the current index buffer
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for(unsigned int index: result) offsets[index + 1]++;
+    for(size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+    adjacency.resize(result.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t t = 0; t < result.size(); t += 3)
+      for(int k = 0; k < 3; k++) adjacency[fill[result[t + k]]++] = t / 3;
+
+    collapses.clear();
+    for(size_t t = 0; t < result.size(); t += 3){
+      for(int k = 0; k < 3; k++){
+        const unsigned int a = result[t + k];
+        const unsigned int b = result[t + (k + 1) % 3];
+        if(!locked[a]) collapses.push_back({a, b, quadrics[canonical[a]].Evaluate(vertices[b].position)});
+        if(!locked[b]) collapses.push_back({b, a, quadrics[canonical[b]].Evaluate(vertices[a].position)});
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y){return x.cost < y.cost;});
+
+    // independent collapses only, each one removes about two triangles
+    const size_t budget = (result.size() - targetIndexCount) / 3;
+    size_t removed = 0;
+    size_t performed = 0;
+    for(size_t v = 0; v < vertexCount; v++) remap[v] = v;
+    std::fill(touched.begin(), touched.end(), false);
+
+    for(auto& c: collapses){
+      if(c.cost > maxCost || removed >= budget) break;
+      if(touched[c.from] || touched[c.to]) continue;
+      if(flips(c.from, c.to)) continue;
+
+      remap[c.from] = c.to;
+      for(unsigned int j = offsets[c.from]; j < offsets[c.from + 1]; j++)
+        for(int k = 0; k < 3; k++) touched[result[adjacency[j] * 3 + k]] = true;
+      quadrics[canonical[c.to]].Add(quadrics[canonical[c.from]]);
+      resultError = std::max(resultError, (float)std::sqrt(c.cost));
+      removed += 2;
+      performed++;
+    }
+    if(performed == 0) break;
+
+    size_t write = 0;
+    for(size_t t = 0; t < result.size(); t += 3){
+      const unsigned int a = remap[result[t]];
+      const unsigned int b = remap[result[t + 1]];
+      const unsigned int c = remap[result[t + 2]];
+      if(a == b || b == c || a == c) continue;
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+  }
+
+  return result;
+}
+
+// reorders vertices by first use in the index buffer and drops unreferenced ones
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices){
+  std::vector<unsigned int> remap(vertices.size(), UINT32_MAX);
+  std::vector<Vertex> output;
+  output.reserve(vertices.size());
+
+  for(unsigned int& index: indices){
+    if(remap[index] == UINT32_MAX){
+      remap[index] = output.size();
+      output.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices.swap(output);
+}
+
+void ComputeBounds(const Vertex* vertices, size_t count, glm::vec3& boundsMin, glm::vec3& boundsMax){
+  boundsMin = glm::vec3(count? FLT_MAX : 0.0f);
+  boundsMax = glm::vec3(count? -FLT_MAX : 0.0f);
+  for(size_t i = 0; i < count; i++){
+    boundsMin = glm::min(boundsMin, vertices[i].position);
+    boundsMax = glm::max(boundsMax, vertices[i].position);
+  }
+}
+
+// contiguous run of LOD 0 triangles with a bounding sphere and a normal cone for CPU culling.
+// coneCutoff is 1 when the triangles face too many directions for the cluster to ever be back-facing
+struct Meshlet{
+  uint32_t indexOffset;
+  uint32_t indexCount;
+  glm::vec3 center;
+  float radius;
+  glm::vec3 coneAxis;
+  float coneCutoff;
+};
+
+// frustum planes and camera position in model space, shared by every mesh of a model for one draw
+struct CullContext{
+  glm::vec4 planes[6];
+  glm::vec3 cameraPos;
+  bool coneCulling;
+
+  // planes from the rows of projection * view * model (Gribb/Hartmann), normalized so they give distances
+  static CullContext From(const glm::mat4& mvp, const glm::vec3& modelSpaceCamera, bool coneCulling){
+    CullContext ctx;
+    const glm::vec4 row0(mvp[0][0], mvp[1][0], mvp[2][0], mvp[3][0]);
+    const glm::vec4 row1(mvp[0][1], mvp[1][1], mvp[2][1], mvp[3][1]);
+    const glm::vec4 row2(mvp[0][2], mvp[1][2], mvp[2][2], mvp[3][2]);
+    const glm::vec4 row3(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3]);
+    ctx.planes[0] = row3 + row0;
+    ctx.planes[1] = row3 - row0;
+    ctx.planes[2] = row3 + row1;
+    ctx.planes[3] = row3 - row1;
+    ctx.planes[4] = row3 + row2;
+    ctx.planes[5] = row3 - row2;
+    for(auto& plane: ctx.planes)
+      plane /= glm::length(glm::vec3(plane));
+    ctx.cameraPos = modelSpaceCamera;
+    ctx.coneCulling = coneCulling;
+    return ctx;
+  }
+
+  bool IsSphereVisible(const glm::vec3& center, float radius) const{
+    for(auto& plane: planes)
+      if(glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    return true;
+  }
+
+  bool IsMeshletVisible(const Meshlet& meshlet) const{
+    if(!IsSphereVisible(meshlet.center, meshlet.radius)) return false;
+    if(!coneCulling) return true;
+    // every triangle faces away when the view direction to the sphere lies inside the cone
+    const glm::vec3 toCenter = meshlet.center - cameraPos;
+    return glm::dot(toCenter, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+  }
+};
+
+// greedily splits the (cache-optimized) triangle order into runs of at most maxVertices unique vertices and
+// maxTriangles triangles, so meshlets are index ranges and the index buffer does not change
+std::vector<Meshlet> BuildMeshlets(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t indexCount, size_t maxVertices = 64, size_t maxTriangles = 124){
+  std::vector<Meshlet> meshlets;
+  std::vector<unsigned int> stamp(vertices.size(), UINT32_MAX);
+  std::vector<unsigned int> used;
+
+  auto finish = [&](size_t begin, size_t end){
+    Meshlet m;
+    m.indexOffset = begin;
+    m.indexCount = end - begin;
+
+    glm::vec3 bmin(FLT_MAX);
+    glm::vec3 bmax(-FLT_MAX);
+    for(unsigned int v: used){
+      bmin = glm::min(bmin, vertices[v].position);
+      bmax = glm::max(bmax, vertices[v].position);
+    }
+    m.center = (bmin + bmax) * 0.5f;
+    m.radius = 0.0f;
+    for(unsigned int v: used)
+      m.radius = std::max(m.radius, glm::length(vertices[v].position - m.center));
+
+    glm::vec3 axis(0.0f);
+    std::vector<glm::vec3> normals;
+    for(size_t i = begin; i < end; i += 3){
+      const glm::vec3& a = vertices[indices[i]].position;
+      const glm::vec3 n = glm::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+      const float len = glm::length(n);
+      if(len <= 0.0f) continue;
+      normals.push_back(n / len);
+      axis += n / len;
+    }
+
+    m.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    m.coneCutoff = 1.0f;
+    const float axisLen = glm::length(axis);
+    if(axisLen > 0.0f){
+      m.coneAxis = axis / axisLen;
+      float minDot = 1.0f;
+      for(auto& n: normals) minDot = std::min(minDot, glm::dot(n, m.coneAxis));
+      if(minDot > 0.0f) m.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+    meshlets.push_back(m);
+  };
+
+  size_t begin = 0;
+  for(size_t i = 0; i < indexCount; i += 3){
+    size_t added = 0;
+    for(int k = 0; k < 3; k++)
+      if(stamp[indices[i + k]] != meshlets.size()) added++;
+
+    if(used.size() + added > maxVertices || (i - begin) / 3 + 1 > maxTriangles){
+      finish(begin, i);
+      used.clear();
+      begin = i;
+    }
+
+    for(int k = 0; k < 3; k++){
+      const unsigned int v = indices[i + k];
+      if(stamp[v] == meshlets.size()) continue;
+      stamp[v] = meshlets.size();
+      used.push_back(v);
+    }
+  }
+  if(begin < indexCount) finish(begin, indexCount);
+
+  return meshlets;
+}
+
+// one level of detail, a range of the shared index buffer and its geometric error in model units
+struct MeshLod{
+  uint32_t indexOffset;
+  uint32_t indexCount;
+  float error;
+};
+
+// constant factors of a mesh's aiMaterial, multiplied with its maps by the shader
+struct MaterialFactors{
+  glm::vec4 baseColor = glm::vec4(1.0f);
+  float roughness = 1.0f;
+  float metallic = 0.0f;
+};
+
+// CPU-side result of converting one aiMesh, safe to build off the GL thread
+struct MeshData{
+  std::vector<Vertex> vertices;
+  std::vector<PackedVertex> packed;
+  std::vector<unsigned int> indices;
+  std::vector<uint16_t> shortIndices;
+  std::vector<MeshLod> lods;
+  std::vector<Meshlet> meshlets;
+  VertexFormat format = VertexFormat::Float;
+  glm::vec3 boundsMin = glm::vec3(0.0f);
+  glm::vec3 boundsMax = glm::vec3(0.0f);
+  MaterialFactors material;
+  VertexCacheStats cacheBefore;
+  VertexCacheStats cacheAfter;
+
+  // quantizes the float vertices into the packed format and drops them
+  void Pack(){
+    const glm::vec3 extent = boundsMax - boundsMin;
+    const glm::vec3 invExtent(extent.x > 0.0f? 1.0f / extent.x : 0.0f, extent.y > 0.0f? 1.0f / extent.y : 0.0f, extent.z > 0.0f? 1.0f / extent.z : 0.0f);
+    packed.resize(vertices.size());
+    for(size_t i = 0; i < vertices.size(); i++)
+      packed[i] = PackVertex(vertices[i], boundsMin, invExtent);
+    std::vector<Vertex>().swap(vertices);
+    format = VertexFormat::Packed;
+  }
+
+  // appends successively halved LODs after LOD 0 until levels is reached, the mesh gets too small to
+  // be worth it, or simplification stalls or exceeds targetError (fraction of the bounds diagonal)
+  void BuildLods(int levels, float targetError){
+    lods.assign(1, {0, (uint32_t)indices.size(), 0.0f});
+    const float maxError = targetError * glm::length(boundsMax - boundsMin);
+
+    std::vector<unsigned int> current = indices;
+    for(int level = 1; level < levels; level++){
+      const size_t target = current.size() / 6 * 3;
+      if(target < 64 * 3) break;
+
+      float error;
+      std::vector<unsigned int> lod = SimplifyMesh(vertices, current, target, maxError, error);
+      if(lod.empty() || lod.size() > current.size() * 9 / 10) break;
+
+      lods.push_back({(uint32_t)indices.size(), (uint32_t)lod.size(), lods.back().error + error});
+      indices.insert(indices.end(), lod.begin(), lod.end());
+      current.swap(lod);
+    }
+  }
+
+  // runs the optimizer stages on the float data and records LOD 0's cache statistics before and after
+  void Optimize(bool overdraw){
+    if(lods.empty()) lods.assign(1, {0, (uint32_t)indices.size(), 0.0f});
+
+    for(size_t l = 0; l < lods.size(); l++){
+      std::vector<unsigned int> range(indices.begin() + lods[l].indexOffset, indices.begin() + lods[l].indexOffset + lods[l].indexCount);
+      if(l == 0) cacheBefore = AnalyzeVertexCache(range, vertices.size());
+      OptimizeVertexCache(range, vertices.size());
+      if(overdraw) OptimizeOverdraw(range, vertices);
+      std::copy(range.begin(), range.end(), indices.begin() + lods[l].indexOffset);
+    }
+
+    // LOD 0 comes first in the index buffer, so fetch order follows the full detail mesh
+    OptimizeVertexFetch(vertices, indices);
+    std::vector<unsigned int> lod0(indices.begin(), indices.begin() + lods[0].indexCount);
+    cacheAfter = AnalyzeVertexCache(lod0, vertices.size());
+  }
+
+  // partitions LOD 0 into meshlets, run after Optimize so clusters follow the final triangle order
+  void BuildMeshlets(){
+    meshlets = ::BuildMeshlets(vertices, indices, lods.empty()? indices.size() : lods[0].indexCount);
+  }
+
+  // switches to 16-bit indices when every vertex is addressable with them
+  void CompactIndices(){
+    if(VertexCount() >= 65536) return;
+    shortIndices.assign(indices.begin(), indices.end());
+    std::vector<unsigned int>().swap(indices);
+  }
+
+  const void* VertexData() const {return (format == VertexFormat::Packed)? (const void*)packed.data() : (const void*)vertices.data();}
+  size_t VertexCount() const {return (format == VertexFormat::Packed)? packed.size() : vertices.size();}
+  const void* IndexData() const {return shortIndices.empty()? (const void*)indices.data() : (const void*)shortIndices.data();}
+  size_t IndexCount() const {return shortIndices.empty()? indices.size() : shortIndices.size();}
+  GLenum IndexType() const {return shortIndices.empty()? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;}
+};
+
+inline size_t IndexStride(GLenum type){
+  return (type == GL_UNSIGNED_SHORT)? sizeof(uint16_t) : sizeof(unsigned int);
+}
+
+// non-owning description of GPU-ready mesh data, either from a MeshData or a mapped cache file
+struct MeshView{
+  const void* vertices = nullptr;
+  size_t vertexCount = 0;
+  VertexFormat format = VertexFormat::Float;
+  const void* indices = nullptr;
+  size_t indexCount = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+  const MeshLod* lods = nullptr;
+  size_t lodCount = 0;
+  const Meshlet* meshlets = nullptr;
+  size_t meshletCount = 0;
+  glm::vec3 boundsMin = glm::vec3(0.0f);
+  glm::vec3 boundsMax = glm::vec3(0.0f);
+  MaterialFactors material;
+
+  static MeshView From(const MeshData& data){
+    MeshView view;
+    view.vertices = data.VertexData();
+    view.vertexCount = data.VertexCount();
+    view.format = data.format;
+    view.indices = data.IndexData();
+    view.indexCount = data.IndexCount();
+    view.indexType = data.IndexType();
+    view.lods = data.lods.data();
+    view.lodCount = data.lods.size();
+    view.meshlets = data.meshlets.data();
+    view.meshletCount = data.meshlets.size();
+    view.boundsMin = data.boundsMin;
+    view.boundsMax = data.boundsMax;
+    view.material = data.material;
+    return view;
+  }
+
+  size_t Bytes() const {return vertexCount * VertexStride(format) + indexCount * IndexStride(indexType);}
+};
+
+struct ImageDeleter{
+  void operator()(unsigned char* p) const {stbi_image_free(p);}
+};
+
+// pixels decoded on a worker thread, waiting to be uploaded on the GL thread. baked images leave pixels
+// empty and carry their whole mip chain in levelData, or in a mapped .ktc file, as GL_RGBA8 or a
+// block-compressed format
+struct DecodedImage{
+  struct Level{
+    int width;
+    int height;
+    size_t offset;
+    size_t size;
+  };
+
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  std::unique_ptr<unsigned char, ImageDeleter> pixels;
+
+  GLenum format = 0;
+  // R8 or RG8 chain of a grey or grey+alpha map, sampled as RRR1 or RRRG through the texture swizzle
+  bool grey = false;
+  std::vector<unsigned char> levelData;
+  std::shared_ptr<MappedFile> mapping;
+  std::vector<Level> levels;
+
+  const unsigned char* LevelPointer(size_t level) const{
+    return (mapping? mapping->Data() : levelData.data()) + levels[level].offset;
+  }
+
+  size_t LevelRangeBytes(size_t first) const{
+    size_t size = 0;
+    for(size_t i = first; i < levels.size(); i++) size += levels[i].size;
+    return size;
+  }
+
+  size_t Bytes() const {return format? LevelRangeBytes(0) : (pixels? (size_t)width * height * channels : 0);}
+};
+
+// periodic byte shuffle over groups of four pixels, e.g. RGB -> RGBA or BGRA -> RGBA. mask[i] < 0 takes
+// fill[i] instead of a source byte. the pattern repeats per pixel, so mask entries for pixel j of a group
+// are those of pixel 0 offset by j * inPixel
+struct ShufflePattern{
+  int inPixel;
+  int outPixel;
+  int8_t mask[16];
+  uint8_t fill[16];
+};
+
+const ShufflePattern SHUFFLE_GRAY_TO_RGBA = {1, 4, {0,0,0,-1, 1,1,1,-1, 2,2,2,-1, 3,3,3,-1}, {0,0,0,255, 0,0,0,255, 0,0,0,255, 0,0,0,255}};
+const ShufflePattern SHUFFLE_GRAY_ALPHA_TO_RGBA = {2, 4, {0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7}, {}};
+const ShufflePattern SHUFFLE_RGB_TO_RGBA = {3, 4, {0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1}, {0,0,0,255, 0,0,0,255, 0,0,0,255, 0,0,0,255}};
+const ShufflePattern SHUFFLE_BGRA_TO_RGBA = {4, 4, {2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15}, {}};
+const ShufflePattern SHUFFLE_RGBA_TO_RGB = {4, 3, {0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1}, {}};
+const ShufflePattern SHUFFLE_RGBA_TO_RG = {4, 2, {0,1, 4,5, 8,9, 12,13, -1,-1,-1,-1,-1,-1,-1,-1}, {}};
+const ShufflePattern SHUFFLE_RGBA_TO_R = {4, 1, {0, 4, 8, 12, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1}, {}};
+const ShufflePattern SHUFFLE_RGBA_TO_RA = {4, 2, {0,3, 4,7, 8,11, 12,15, -1,-1,-1,-1,-1,-1,-1,-1}, {}};
+
+enum class CpuLevel{Scalar, SSSE3, AVX2};
+
+inline CpuLevel DetectCpuLevel(){
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+  static const CpuLevel level = __builtin_cpu_supports("avx2")? CpuLevel::AVX2 :
+                                __builtin_cpu_supports("ssse3")? CpuLevel::SSSE3 : CpuLevel::Scalar;
+  return level;
+#else
+  return CpuLevel::Scalar;
+#endif
+}
+
+// the SIMD paths handle whole groups while a full 16-byte load and store stay inside both buffers,
+// the scalar loop finishes the rest pixel by pixel
+size_t ShufflePixelsScalar(const ShufflePattern& pattern, const unsigned char* src, unsigned char* dst, size_t first, size_t count){
+  for(size_t i = first; i < count; i++)
+    for(int k = 0; k < pattern.outPixel; k++){
+      const int m = pattern.mask[k];
+      dst[i * pattern.outPixel + k] = (m < 0)? pattern.fill[k] : src[i * pattern.inPixel + m];
+    }
+  return count;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+__attribute__((target("ssse3")))
+size_t ShufflePixelsSSSE3(const ShufflePattern& pattern, const unsigned char* src, unsigned char* dst, size_t count){
+  const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.mask));
+  const __m128i fill = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.fill));
+  size_t i = 0;
+  for(; i * pattern.inPixel + 16 <= count * pattern.inPixel && i * pattern.outPixel + 16 <= count * pattern.outPixel; i += 4){
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * pattern.inPixel));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * pattern.outPixel), _mm_or_si128(_mm_shuffle_epi8(v, mask), fill));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+size_t ShufflePixelsAVX2(const ShufflePattern& pattern, const unsigned char* src, unsigned char* dst, size_t count){
+  const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.mask)));
+  const __m256i fill = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.fill)));
+  const size_t inGroup = 4 * pattern.inPixel;
+  const size_t outGroup = 4 * pattern.outPixel;
+  size_t i = 0;
+  // two groups per step, one per 128-bit lane since vpshufb does not cross lanes
+  for(; i * pattern.inPixel + inGroup + 16 <= count * pattern.inPixel && i * pattern.outPixel + outGroup + 16 <= count * pattern.outPixel; i += 8){
+    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * pattern.inPixel));
+    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * pattern.inPixel + inGroup));
+    const __m256i v = _mm256_or_si256(_mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), mask), fill);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * pattern.outPixel), _mm256_castsi256_si128(v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * pattern.outPixel + outGroup), _mm256_extracti128_si256(v, 1));
+  }
+  return i;
+}
+#endif
+
+// src and dst must not overlap
+void ShufflePixels(const ShufflePattern& pattern, const unsigned char* src, unsigned char* dst, size_t count){
+  size_t done = 0;
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+  const CpuLevel level = DetectCpuLevel();
+  if(level == CpuLevel::AVX2) done = ShufflePixelsAVX2(pattern, src, dst, count);
+  if(level != CpuLevel::Scalar) done += ShufflePixelsSSSE3(pattern, src + done * pattern.inPixel, dst + done * pattern.outPixel, count - done);
+#endif
+  ShufflePixelsScalar(pattern, src, dst, done, count);
+}
+
+// rgb = rgb * a / 255 with rounding, alpha untouched
+void PremultiplyAlpha(unsigned char* rgba, size_t count){
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi16(128);
+  const __m128i alphaMask = _mm_set1_epi64x(0xffff000000000000ll);
+  for(; i + 4 <= count; i += 4){
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+    __m128i result[2];
+    for(int half = 0; half < 2; half++){
+      const __m128i c = half? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero);
+      const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), bias);
+      t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+      result[half] = _mm_or_si128(_mm_andnot_si128(alphaMask, t), _mm_and_si128(alphaMask, c));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), _mm_packus_epi16(result[0], result[1]));
+  }
+#endif
+  for(; i < count; i++){
+    unsigned char* p = rgba + i * 4;
+    for(int c = 0; c < 3; c++){
+      const int t = p[c] * p[3] + 128;
+      p[c] = (t + (t >> 8)) >> 8;
+    }
+  }
+}
+
+// swaps rows top to bottom in place, stb_image decodes top-down while GL samples bottom-up
+void FlipRows(unsigned char* pixels, size_t rowBytes, int height){
+  for(int y = 0; y < height / 2; y++){
+    unsigned char* a = pixels + (size_t)y * rowBytes;
+    unsigned char* b = pixels + (size_t)(height - 1 - y) * rowBytes;
+    size_t x = 0;
+#if defined(__SSE2__)
+    for(; x + 16 <= rowBytes; x += 16){
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(a + x), vb);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(b + x), va);
+    }
+#endif
+    for(; x < rowBytes; x++) std::swap(a[x], b[x]);
+  }
+}
+
+// decodes keep the file's own channel count (1-4), the bake step expands them once to RGBA
+DecodedImage DecodeImageMemory(const unsigned char* bytes, size_t size, const std::string& name = "embedded texture"){
+  DecodedImage image;
+  if(size > INT_MAX){
+    std::cerr<<"WARNING: decoding "<<name<<" -> too large"<<std::endl;
+    return image;
+  }
+  image.pixels.reset(stbi_load_from_memory(bytes, (int)size, &image.width, &image.height, &image.channels, 0));
+  if(!image.pixels) std::cerr<<"WARNING: decoding "<<name<<" -> "<<stbi_failure_reason()<<std::endl;
+  return image;
+}
+
+// stb reads straight out of the page cache instead of through buffered freads
+DecodedImage DecodeImageFile(const std::string& path){
+  MappedFile file;
+  if(!file.Open(path, MADV_SEQUENTIAL)){
+    std::cerr<<"WARNING: opening texture -> "<<path<<std::endl;
+    return DecodedImage();
+  }
+  return DecodeImageMemory(file.Data(), file.Size(), path);
+}
+
+// uncompressed embedded texels are BGRA aiTexels, copied to RGBA so the image outlives the aiScene or
+// mapping it came from
+DecodedImage CopyImagePixels(const void* pixels, int width, int height){
+  DecodedImage image;
+  const size_t size = (size_t)width * height * 4;
+  image.pixels.reset(static_cast<unsigned char*>(malloc(size)));
+  if(!image.pixels) return image;
+  ShufflePixels(SHUFFLE_BGRA_TO_RGBA, static_cast<const unsigned char*>(pixels), image.pixels.get(), (size_t)width * height);
+  image.width = width;
+  image.height = height;
+  image.channels = 4;
+  return image;
+}
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// GL thread only
+bool HasGLExtension(const char* name){
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for(GLint i = 0; i < count; i++){
+    const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+    if(ext && strcmp(ext, name) == 0) return true;
+  }
+  return false;
+}
+
+// what a map stores decides its block format: colour keeps RGB(A), normals only need XY, masks one
+// channel, and packed occlusion/roughness/metallic maps three linear channels
+enum class TextureUsage{Color, Normal, Mask, Orm};
+
+// colour map encoding, BC1 falls back to BC3 for images with alpha
+enum class TextureCompression : uint32_t {None, BC1, BC7};
+
+// how maps are baked, the defaults store what the original RGBA upload did
+struct BakeOptions{
+  TextureCompression compression = TextureCompression::None;
+  bool flip = false;
+  bool premultiply = false;
+  // colour maps in sRGB formats, so they sample as linear and need sRGB output to look unchanged
+  bool srgb = false;
+  // uncompressed normals as RG8 (the shader rebuilds z, as with BC5) and masks as R8
+  bool compact = false;
+};
+
+TextureUsage UsageForType(const std::string& type){
+  if(type == "texture_normal") return TextureUsage::Normal;
+  if(type == "texture_specular") return TextureUsage::Mask;
+  if(type == "texture_orm") return TextureUsage::Orm;
+  return TextureUsage::Color;
+}
+
+// distinguishes the baked cache files (and TextureCache entries) made from one source image
+std::string TextureCacheSuffix(TextureUsage usage, const BakeOptions& options){
+  std::string suffix;
+  const bool linear = usage == TextureUsage::Orm || (usage == TextureUsage::Color && !options.srgb);
+  if(options.compression == TextureCompression::None){
+    if(usage == TextureUsage::Normal) suffix = options.compact? "rg8" : "rgba8n";
+    else if(usage == TextureUsage::Mask) suffix = options.compact? "r8" : "rgba8m";
+    else suffix = linear? "rgb8" : "srgb8";
+  }
+  else if(usage == TextureUsage::Normal) suffix = "bc5";
+  else if(usage == TextureUsage::Mask) suffix = "bc4";
+  else suffix = (options.compression == TextureCompression::BC7)? "bc7" : "bc1";
+  if(linear && options.compression != TextureCompression::None) suffix += "l";
+  if(options.flip) suffix += "f";
+  if(options.premultiply && usage == TextureUsage::Color) suffix += "p";
+  return suffix;
+}
+
+inline size_t BlockBytes(GLenum format){
+  return (format == GL_COMPRESSED_SRGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1)? 8 : 16;
+}
+
+// bytes per pixel of the uncompressed formats baked chains use, 0 for block formats
+inline int UncompressedChannels(GLenum format){
+  switch(format){
+    case GL_R8: return 1;
+    case GL_RG8: return 2;
+    case GL_SRGB8: case GL_RGB8: return 3;
+    case GL_SRGB8_ALPHA8: case GL_RGBA8: return 4;
+    default: return 0;
+  }
+}
+
+inline GLenum PixelFormatForChannels(int channels){
+  static const GLenum formats[] = {GL_RED, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+  return formats[std::min(std::max(channels, 0), 4)];
+}
+
+inline size_t LevelBytes(GLenum format, int width, int height){
+  if(const int channels = UncompressedChannels(format)) return (size_t)width * height * channels;
+  return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+// 4x4 RGBA block, edges are clamped for images that are not a multiple of 4
+void FetchBlock(const unsigned char* rgba, int width, int height, int bx, int by, float block[16][4]){
+  for(int y = 0; y < 4; y++)
+    for(int x = 0; x < 4; x++){
+      const int sx = std::min(bx * 4 + x, width - 1);
+      const int sy = std::min(by * 4 + y, height - 1);
+      const unsigned char* p = rgba + ((size_t)sy * width + sx) * 4;
+      for(int c = 0; c < 4; c++) block[y * 4 + x][c] = p[c];
+    }
+}
+
+// endpoints at the extremes of the block's principal axis (power iteration on the covariance),
+// pulled in by inset of the range on each side
+void FitEndpoints(const float block[16][4], int channels, float inset, float e0[4], float e1[4]){
+  float mean[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for(int i = 0; i < 16; i++)
+    for(int c = 0; c < channels; c++) mean[c] += block[i][c] / 16.0f;
+
+  float cov[4][4] = {};
+  for(int i = 0; i < 16; i++)
+    for(int a = 0; a < channels; a++)
+      for(int b = 0; b < channels; b++) cov[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+  float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for(int iter = 0; iter < 8; iter++){
+    float next[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float largest = 0.0f;
+    for(int a = 0; a < channels; a++){
+      for(int b = 0; b < channels; b++) next[a] += cov[a][b] * axis[b];
+      largest = std::max(largest, std::fabs(next[a]));
+    }
+    if(largest <= 0.0f) break;
+    for(int a = 0; a < channels; a++) axis[a] = next[a] / largest;
+  }
+
+  float length = 0.0f;
+  for(int c = 0; c < channels; c++) length += axis[c] * axis[c];
+  length = std::sqrt(length);
+
+  float tmin = 0.0f;
+  float tmax = 0.0f;
+  if(length > 0.0f){
+    for(int c = 0; c < channels; c++) axis[c] /= length;
+    tmin = FLT_MAX;
+    tmax = -FLT_MAX;
+    for(int i = 0; i < 16; i++){
+      float t = 0.0f;
+      for(int c = 0; c < channels; c++) t += (block[i][c] - mean[c]) * axis[c];
+      tmin = std::min(tmin, t);
+      tmax = std::max(tmax, t);
+    }
+    const float shrink = (tmax - tmin) * inset;
+    tmin += shrink;
+    tmax -= shrink;
+  }
+
+  for(int c = 0; c < 4; c++){
+    const float a = (c < channels)? axis[c] : 0.0f;
+    e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + a * tmin));
+    e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + a * tmax));
+  }
+}
+
+inline uint16_t To565(const float c[4]){
+  const int r = std::min(31, (int)std::lround(c[0] * 31.0f / 255.0f));
+  const int g = std::min(63, (int)std::lround(c[1] * 63.0f / 255.0f));
+  const int b = std::min(31, (int)std::lround(c[2] * 31.0f / 255.0f));
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void From565(uint16_t v, float c[4]){
+  const int r = (v >> 11) & 31;
+  const int g = (v >> 5) & 63;
+  const int b = v & 31;
+  c[0] = (float)((r << 3) | (r >> 2));
+  c[1] = (float)((g << 2) | (g >> 4));
+  c[2] = (float)((b << 3) | (b >> 2));
+  c[3] = 255.0f;
+}
+
+// BC1 colour block in four-colour mode, also the colour half of BC3
+void EncodeBC1Block(const float block[16][4], unsigned char* out){
+  float e0[4], e1[4];
+  FitEndpoints(block, 3, 1.0f / 16.0f, e0, e1);
+  uint16_t c0 = To565(e1);
+  uint16_t c1 = To565(e0);
+  if(c0 < c1) std::swap(c0, c1);
+
+  uint32_t bits = 0;
+  if(c0 != c1){
+    float palette[4][4];
+    From565(c0, palette[0]);
+    From565(c1, palette[1]);
+    for(int c = 0; c < 3; c++){
+      palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+      palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    for(int i = 0; i < 16; i++){
+      int best = 0;
+      float bestError = FLT_MAX;
+      for(int k = 0; k < 4; k++){
+        float error = 0.0f;
+        for(int c = 0; c < 3; c++) error += (block[i][c] - palette[k][c]) * (block[i][c] - palette[k][c]);
+        if(error < bestError){
+          bestError = error;
+          best = k;
+        }
+      }
+      bits |= (uint32_t)best << (2 * i);
+    }
+  }
+
+  out[0] = c0 & 0xff;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xff;
+  out[3] = c1 >> 8;
+  for(int i = 0; i < 4; i++) out[4 + i] = (bits >> (8 * i)) & 0xff;
+}
+
+// BC4 single channel block in eight-value mode, the alpha half of BC3 and each half of BC5
+void EncodeBC4Block(const float block[16][4], int channel, unsigned char* out){
+  float lo = 255.0f;
+  float hi = 0.0f;
+  for(int i = 0; i < 16; i++){
+    lo = std::min(lo, block[i][channel]);
+    hi = std::max(hi, block[i][channel]);
+  }
+  const int a0 = (int)std::lround(hi);
+  const int a1 = (int)std::lround(lo);
+
+  uint64_t bits = 0;
+  if(a0 != a1){
+    float palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for(int k = 2; k < 8; k++) palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7.0f;
+    for(int i = 0; i < 16; i++){
+      int best = 0;
+      for(int k = 1; k < 8; k++)
+        if(std::fabs(block[i][channel] - palette[k]) < std::fabs(block[i][channel] - palette[best])) best = k;
+      bits |= (uint64_t)best << (3 * i);
+    }
+  }
+
+  out[0] = a0;
+  out[1] = a1;
+  for(int i = 0; i < 6; i++) out[2 + i] = (bits >> (8 * i)) & 0xff;
+}
+
+// BC7 mode 6: one subset, RGBA 7-bit endpoints with a p-bit each and 4-bit indices
+void EncodeBC7Block(const float block[16][4], unsigned char* out){
+  static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+  float ends[2][4];
+  FitEndpoints(block, 4, 0.0f, ends[0], ends[1]);
+
+  // quantize each endpoint with whichever p-bit lands closer
+  int q[2][4];
+  int pbit[2];
+  for(int e = 0; e < 2; e++){
+    float bestError = FLT_MAX;
+    for(int p = 0; p < 2; p++){
+      int cand[4];
+      float error = 0.0f;
+      for(int c = 0; c < 4; c++){
+        cand[c] = std::min(127, std::max(0, (int)std::lround((ends[e][c] - p) * 0.5f)));
+        const float d = (float)(cand[c] * 2 + p) - ends[e][c];
+        error += d * d;
+      }
+      if(error < bestError){
+        bestError = error;
+        pbit[e] = p;
+        memcpy(q[e], cand, sizeof(cand));
+      }
+    }
+  }
+
+  float palette[16][4];
+  for(int k = 0; k < 16; k++)
+    for(int c = 0; c < 4; c++){
+      const int v0 = q[0][c] * 2 + pbit[0];
+      const int v1 = q[1][c] * 2 + pbit[1];
+      palette[k][c] = (float)(((64 - weights[k]) * v0 + weights[k] * v1 + 32) >> 6);
+    }
+
+  int indices[16];
+  for(int i = 0; i < 16; i++){
+    int best = 0;
+    float bestError = FLT_MAX;
+    for(int k = 0; k < 16; k++){
+      float error = 0.0f;
+      for(int c = 0; c < 4; c++) error += (block[i][c] - palette[k][c]) * (block[i][c] - palette[k][c]);
+      if(error < bestError){
+        bestError = error;
+        best = k;
+      }
+    }
+    indices[i] = best;
+  }
+
+  // the first index is stored without its top bit, so it must be below 8
+  if(indices[0] >= 8){
+    std::swap(q[0], q[1]);
+    std::swap(pbit[0], pbit[1]);
+    for(int& index: indices) index = 15 - index;
+  }
+
+  uint64_t words[2] = {0, 0};
+  int position = 0;
+  auto put = [&](uint64_t value, int count){
+    for(int b = 0; b < count; b++, position++)
+      if((value >> b) & 1) words[position >> 6] |= 1ull << (position & 63);
+  };
+  put(1 << 6, 7);
+  for(int c = 0; c < 4; c++){
+    put(q[0][c], 7);
+    put(q[1][c], 7);
+  }
+  put(pbit[0], 1);
+  put(pbit[1], 1);
+  put(indices[0], 3);
+  for(int i = 1; i < 16; i++) put(indices[i], 4);
+
+  memcpy(out, words, 16);
+}
+
+// sRGB <-> linear tables, colour maps are filtered in linear light
+struct SrgbTables{
+  float toLinear[256];
+  unsigned char toSrgb[4096];
+
+  SrgbTables(){
+    for(int i = 0; i < 256; i++){
+      const float c = i / 255.0f;
+      toLinear[i] = (c <= 0.04045f)? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for(int i = 0; i < 4096; i++){
+      const float l = i / 4095.0f;
+      const float c = (l <= 0.0031308f)? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+      toSrgb[i] = (unsigned char)std::lround(c * 255.0f);
+    }
+  }
+
+  static const SrgbTables& Get(){
+    static const SrgbTables tables;
+    return tables;
+  }
+};
+
+// one output row of a 2x2 box filter, odd edges reuse their last row/column
+void DownsampleRow(const unsigned char* src, int width, int height, unsigned char* dst, int outWidth, int y, TextureUsage usage){
+  const unsigned char* row0 = src + (size_t)std::min(y * 2, height - 1) * width * 4;
+  const unsigned char* row1 = src + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+  unsigned char* out = dst + (size_t)y * outWidth * 4;
+  int x = 0;
+
+  if(usage == TextureUsage::Mask || usage == TextureUsage::Orm){
+#if defined(__SSE2__)
+    // two output pixels per step from four source pixels of each row
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    for(; x + 1 < outWidth && x * 2 + 3 < width; x += 2){
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+      const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+      const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+      const __m128i sumLo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+      const __m128i sumHi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+      const __m128i avg = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sumLo, sumHi), two), 2);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(avg, zero));
+    }
+#endif
+    for(; x < outWidth; x++){
+      const int x0 = std::min(x * 2, width - 1) * 4;
+      const int x1 = std::min(x * 2 + 1, width - 1) * 4;
+      for(int c = 0; c < 4; c++) out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4;
+    }
+    return;
+  }
+
+  const SrgbTables& tables = SrgbTables::Get();
+  for(; x < outWidth; x++){
+    const unsigned char* taps[4] = {row0 + std::min(x * 2, width - 1) * 4, row0 + std::min(x * 2 + 1, width - 1) * 4,
+                                    row1 + std::min(x * 2, width - 1) * 4, row1 + std::min(x * 2 + 1, width - 1) * 4};
+    float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    if(usage == TextureUsage::Color){
+      for(auto tap: taps){
+        for(int c = 0; c < 3; c++) sum[c] += tables.toLinear[tap[c]];
+        sum[3] += tap[3];
+      }
+      for(int c = 0; c < 3; c++) out[x * 4 + c] = tables.toSrgb[(int)(sum[c] * 0.25f * 4095.0f + 0.5f)];
+    }
+    else{
+      // average the unit vectors and put the result back on the sphere
+      for(auto tap: taps){
+        for(int c = 0; c < 3; c++) sum[c] += tap[c] / 127.5f - 1.0f;
+        sum[3] += tap[3];
+      }
+      const float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+      const float scale = (length > 0.0f)? 1.0f / length : 0.0f;
+      for(int c = 0; c < 3; c++){
+        const float n = (length > 0.0f)? sum[c] * scale : (c == 2? 1.0f : 0.0f);
+        out[x * 4 + c] = (unsigned char)std::lround((n * 0.5f + 0.5f) * 255.0f);
+      }
+    }
+    out[x * 4 + 3] = (unsigned char)((sum[3] + 2.0f) / 4.0f);
+  }
+}
+
+// turns a freshly decoded 1-4 channel image into the RGBA8 the mip filter and block encoders work on
+void PrepareForBaking(DecodedImage& image, TextureUsage usage, const BakeOptions& options){
+  const size_t count = (size_t)image.width * image.height;
+  const int sourceChannels = image.channels;
+  if(sourceChannels != 4){
+    static const ShufflePattern* patterns[] = {nullptr, &SHUFFLE_GRAY_TO_RGBA, &SHUFFLE_GRAY_ALPHA_TO_RGBA, &SHUFFLE_RGB_TO_RGBA};
+    std::unique_ptr<unsigned char, ImageDeleter> rgba(static_cast<unsigned char*>(malloc(count * 4)));
+    ShufflePixels(*patterns[std::min(std::max(sourceChannels, 1), 3)], image.pixels.get(), rgba.get(), count);
+    image.pixels = std::move(rgba);
+    image.channels = 4;
+  }
+  if(options.flip) FlipRows(image.pixels.get(), (size_t)image.width * 4, image.height);
+  if(options.premultiply && usage == TextureUsage::Color && (sourceChannels == 2 || sourceChannels == 4)) PremultiplyAlpha(image.pixels.get(), count);
+}
+
+bool HasTransparency(const unsigned char* rgba, size_t count){
+  for(size_t i = 0; i < count; i++)
+    if(rgba[i * 4 + 3] != 255) return true;
+  return false;
+}
+
+bool IsGrey(const unsigned char* rgba, size_t count){
+  for(size_t i = 0; i < count; i++)
+    if(rgba[i * 4] != rgba[i * 4 + 1] || rgba[i * 4] != rgba[i * 4 + 2]) return false;
+  return true;
+}
+
+// repacks an RGBA8 chain to the smallest format the map needs: colour with alpha only when some texel
+// uses it, grey colour maps and masks as R8 or RG8 read back through a swizzle and, when compact, R8
+// masks and RG8 normals (Z is rebuilt in the shader, as with BC5). there is no one or two channel sRGB
+// format, grey maps baked for sRGB keep three or four channels
+DecodedImage PackImage(const DecodedImage& chain, TextureUsage usage, const BakeOptions& options){
+  DecodedImage image;
+  image.width = chain.width;
+  image.height = chain.height;
+  const bool alpha = HasTransparency(chain.levelData.data(), (size_t)chain.width * chain.height);
+  const bool srgb = options.srgb && usage == TextureUsage::Color;
+  image.grey = !srgb && (usage == TextureUsage::Color || (usage == TextureUsage::Mask && !options.compact)) &&
+               IsGrey(chain.levelData.data(), chain.levelData.size() / 4);
+  if(usage == TextureUsage::Normal) image.format = options.compact? GL_RG8 : GL_RGBA8;
+  else if(image.grey) image.format = alpha? GL_RG8 : GL_R8;
+  else if(usage == TextureUsage::Mask) image.format = options.compact? GL_R8 : GL_RGBA8;
+  else if(usage == TextureUsage::Orm) image.format = GL_RGB8;
+  else if(srgb) image.format = alpha? GL_SRGB8_ALPHA8 : GL_SRGB8;
+  else image.format = alpha? GL_RGBA8 : GL_RGB8;
+  image.channels = UncompressedChannels(image.format);
+
+  for(auto& level: chain.levels){
+    image.levels.push_back({level.width, level.height, image.levelData.size(), LevelBytes(image.format, level.width, level.height)});
+    image.levelData.resize(image.levelData.size() + image.levels.back().size);
+  }
+
+  static const ShufflePattern* patterns[] = {nullptr, &SHUFFLE_RGBA_TO_R, &SHUFFLE_RGBA_TO_RG, &SHUFFLE_RGBA_TO_RGB};
+  for(size_t i = 0; i < chain.levels.size(); i++){
+    const unsigned char* src = chain.levelData.data() + chain.levels[i].offset;
+    unsigned char* dst = image.levelData.data() + image.levels[i].offset;
+    const size_t count = (size_t)chain.levels[i].width * chain.levels[i].height;
+    if(image.channels == 4) memcpy(dst, src, count * 4);
+    else if(image.grey && alpha) ShufflePixels(SHUFFLE_RGBA_TO_RA, src, dst, count);
+    else ShufflePixels(*patterns[image.channels], src, dst, count);
+  }
+  return image;
+}
+
+// full GL_RGBA8 mip chain, each level filtered from the previous one with its rows spread over the pool
+DecodedImage GenerateMips(const DecodedImage& source, TextureUsage usage){
+  DecodedImage image;
+  image.width = source.width;
+  image.height = source.height;
+  image.channels = 4;
+  image.format = GL_RGBA8;
+
+  const size_t baseSize = LevelBytes(GL_RGBA8, source.width, source.height);
+  image.levelData.assign(source.pixels.get(), source.pixels.get() + baseSize);
+  image.levels.push_back({source.width, source.height, 0, baseSize});
+
+  for(;;){
+    const DecodedImage::Level previous = image.levels.back();
+    if(previous.width == 1 && previous.height == 1) break;
+
+    const int width = std::max(1, previous.width / 2);
+    const int height = std::max(1, previous.height / 2);
+    const DecodedImage::Level level = {width, height, image.levelData.size(), LevelBytes(GL_RGBA8, width, height)};
+    image.levelData.resize(level.offset + level.size);
+
+    const unsigned char* src = image.levelData.data() + previous.offset;
+    unsigned char* dst = image.levelData.data() + level.offset;
+    const int rowsPerTask = 32;
+    ThreadPool::Get().ParallelFor((height + rowsPerTask - 1) / rowsPerTask, [&](size_t task){
+      const int end = std::min(height, (int)(task + 1) * rowsPerTask);
+      for(int y = task * rowsPerTask; y < end; y++) DownsampleRow(src, previous.width, previous.height, dst, width, y, usage);
+    });
+    image.levels.push_back(level);
+  }
+  return image;
+}
+
+// encodes every level of a GL_RGBA8 mip chain, block rows are spread over the pool
+DecodedImage CompressImage(const DecodedImage& source, TextureUsage usage, const BakeOptions& options){
+  const TextureCompression compression = options.compression;
+  DecodedImage image;
+  image.width = source.width;
+  image.height = source.height;
+  image.channels = source.channels;
+
+  if(usage == TextureUsage::Normal) image.format = GL_COMPRESSED_RG_RGTC2;
+  else if(usage == TextureUsage::Mask) image.format = GL_COMPRESSED_RED_RGTC1;
+  else if(usage == TextureUsage::Orm) image.format = (compression == TextureCompression::BC7)? GL_COMPRESSED_RGBA_BPTC_UNORM : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  else if(compression == TextureCompression::BC7) image.format = options.srgb? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+  else if(HasTransparency(source.levelData.data(), (size_t)source.width * source.height))
+    image.format = options.srgb? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  else image.format = options.srgb? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  const size_t blockBytes = BlockBytes(image.format);
+
+  for(auto& level: source.levels){
+    DecodedImage::Level info = {level.width, level.height, image.levelData.size(), LevelBytes(image.format, level.width, level.height)};
+    image.levelData.resize(info.offset + info.size);
+    image.levels.push_back(info);
+  }
+
+  for(size_t i = 0; i < source.levels.size(); i++){
+    const DecodedImage::Level& level = source.levels[i];
+    const unsigned char* pixels = source.levelData.data() + level.offset;
+    unsigned char* blocks = image.levelData.data() + image.levels[i].offset;
+    const int blocksX = (level.width + 3) / 4;
+    const int blocksY = (level.height + 3) / 4;
+
+    ThreadPool::Get().ParallelFor(blocksY, [&](size_t by){
+      unsigned char* out = blocks + by * blocksX * blockBytes;
+      float block[16][4];
+      for(int bx = 0; bx < blocksX; bx++, out += blockBytes){
+        FetchBlock(pixels, level.width, level.height, bx, by, block);
+        switch(image.format){
+          case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT: case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: EncodeBC1Block(block, out); break;
+          case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT: case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: EncodeBC4Block(block, 3, out); EncodeBC1Block(block, out + 8); break;
+          case GL_COMPRESSED_RED_RGTC1: EncodeBC4Block(block, 0, out); break;
+          case GL_COMPRESSED_RG_RGTC2: EncodeBC4Block(block, 0, out); EncodeBC4Block(block, 1, out + 8); break;
+          default: EncodeBC7Block(block, out); break;
+        }
+      }
+    });
+  }
+  return image;
+}
+
+// bilinear sample of one channel with clamped edges
+float SampleChannel(const DecodedImage& image, int c, float u, float v){
+  const float x = std::min(std::max(u * image.width - 0.5f, 0.0f), (float)(image.width - 1));
+  const float y = std::min(std::max(v * image.height - 0.5f, 0.0f), (float)(image.height - 1));
+  const int x0 = (int)x, y0 = (int)y;
+  const int x1 = std::min(x0 + 1, image.width - 1), y1 = std::min(y0 + 1, image.height - 1);
+  const float fx = x - x0, fy = y - y0;
+  auto at = [&](int px, int py){return (float)image.pixels.get()[((size_t)py * image.width + px) * image.channels + c];};
+  return (at(x0, y0) * (1.0f - fx) + at(x1, y0) * fx) * (1.0f - fy) + (at(x0, y1) * (1.0f - fx) + at(x1, y1) * fx) * fy;
+}
+
+// packs occlusion, roughness and metallic into R, G and B at the largest input size. when roughness and
+// metallic come from one image it is read as a glTF metallicRoughness map (G roughness, B metallic),
+// otherwise each map's first channel is used. missing maps mean no occlusion, fully rough, not metallic
+DecodedImage PackOrm(const DecodedImage maps[3], bool sharedMetalRough){
+  const unsigned char defaults[3] = {255, 255, 0};
+  int channels[3] = {0, sharedMetalRough? 1 : 0, sharedMetalRough? 2 : 0};
+  // grey images answer every channel from their first
+  for(int m = 0; m < 3; m++)
+    if(maps[m].channels < 3) channels[m] = 0;
+
+  DecodedImage image;
+  for(int m = 0; m < 3; m++){
+    image.width = std::max(image.width, maps[m].pixels? maps[m].width : 0);
+    image.height = std::max(image.height, maps[m].pixels? maps[m].height : 0);
+  }
+  if(image.width == 0 || image.height == 0) return image;
+
+  image.channels = 4;
+  image.pixels.reset(static_cast<unsigned char*>(malloc((size_t)image.width * image.height * 4)));
+  if(!image.pixels) return image;
+
+  ThreadPool::Get().ParallelFor(image.height, [&](size_t y){
+    unsigned char* out = image.pixels.get() + y * image.width * 4;
+    const float v = (y + 0.5f) / image.height;
+    for(int x = 0; x < image.width; x++, out += 4){
+      const float u = (x + 0.5f) / image.width;
+      for(int m = 0; m < 3; m++){
+        const DecodedImage& map = maps[m];
+        if(!map.pixels) out[m] = defaults[m];
+        else if(map.width == image.width && map.height == image.height) out[m] = map.pixels.get()[((size_t)y * map.width + x) * map.channels + channels[m]];
+        else out[m] = (unsigned char)std::lround(SampleChannel(map, channels[m], u, v));
+      }
+      out[3] = 255;
+    }
+  });
+  return image;
+}
+
+const char TEXTURE_CACHE_MAGIC[4] = {'P','B','R','T'};
+const uint32_t TEXTURE_CACHE_VERSION = 4;
+
+struct TextureCacheHeader{
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levelCount;
+  uint32_t grey;
+};
+
+// binary layout:
+//   TextureCacheHeader
+//   per level: width, height (uint32), size (uint64)
+//   level blocks, each 16-byte aligned
+bool SaveTextureCache(const std::string& path, uint64_t sourceHash, const DecodedImage& image){
+  BinaryWriter writer;
+  TextureCacheHeader header = {};
+  memcpy(header.magic, TEXTURE_CACHE_MAGIC, 4);
+  header.version = TEXTURE_CACHE_VERSION;
+  header.sourceHash = sourceHash;
+  header.format = image.format;
+  header.width = image.width;
+  header.height = image.height;
+  header.levelCount = image.levels.size();
+  header.grey = image.grey;
+  writer.Write(header);
+  for(auto& level: image.levels){
+    writer.Write<uint32_t>(level.width);
+    writer.Write<uint32_t>(level.height);
+    writer.Write<uint64_t>(level.size);
+  }
+  for(auto& level: image.levels){
+    writer.Align(16);
+    writer.Write(image.LevelPointer(&level - image.levels.data()), level.size);
+  }
+  return writer.SaveToFile(path);
+}
+
+// false when the file is missing, stale or malformed, the caller then compresses from the source.
+// the levels are not copied, the image keeps the file mapped and reads them from there
+bool LoadTextureCache(const std::string& path, uint64_t sourceHash, DecodedImage& image){
+  MappedFile file;
+  if(!file.Open(path)) return false;
+
+  BinaryReader reader(file.Data(), file.Size());
+  TextureCacheHeader header;
+  if(!reader.Read(header)) return false;
+  if(memcmp(header.magic, TEXTURE_CACHE_MAGIC, 4) != 0 || header.version != TEXTURE_CACHE_VERSION) return false;
+  if(header.sourceHash != sourceHash || header.levelCount == 0) return false;
+
+  image.width = header.width;
+  image.height = header.height;
+  image.channels = 4;
+  image.format = header.format;
+  image.grey = header.grey != 0;
+  image.levels.clear();
+  image.levelData.clear();
+  for(uint32_t i = 0; i < header.levelCount; i++){
+    uint32_t width, height;
+    uint64_t size;
+    if(!reader.Read(width) || !reader.Read(height) || !reader.Read(size)) return false;
+    if(width == 0 || height == 0 || LevelBytes(image.format, width, height) != size) return false;
+    image.levels.push_back({(int)width, (int)height, 0, size});
+  }
+  for(auto& level: image.levels){
+    if(!reader.Align(16)) return false;
+    const unsigned char* blocks = reader.Skip(level.size);
+    if(!blocks) return false;
+    level.offset = blocks - file.Data();
+  }
+  image.mapping = std::make_shared<MappedFile>(std::move(file));
+  return true;
+}
+
+// loads a baked chain from cachePath, or decodes, bakes and writes it there. runs on a worker thread
+DecodedImage BakeTexture(const std::string& cachePath, uint64_t sourceHash, const std::function<DecodedImage()>& decode,
+                         TextureUsage usage, const BakeOptions& options){
+  DecodedImage image;
+  if(LoadTextureCache(cachePath, sourceHash, image)) return image;
+
+  image = decode();
+  if(!image.pixels) return image;
+  PrepareForBaking(image, usage, options);
+  image = GenerateMips(image, usage);
+  image = (options.compression != TextureCompression::None)? CompressImage(image, usage, options) : PackImage(image, usage, options);
+  if(!SaveTextureCache(cachePath, sourceHash, image))
+    std::cerr<<"WARNING: writing texture cache -> "<<cachePath<<std::endl;
+  return image;
+}
+
+// for the bound texture of a grey chain, which then samples as the RGB(A) map shaders were written for
+void SetGreySwizzle(GLenum target, GLenum format){
+  const GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, (format == GL_RG8)? GL_GREEN : GL_ONE};
+  glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+// (re)specifies one level of the bound texture from a baked chain, or releases its storage
+void UploadTextureLevel(const DecodedImage& image, size_t i, bool release = false){
+  const DecodedImage::Level& level = image.levels[i];
+  const int width = release? 0 : level.width;
+  const int height = release? 0 : level.height;
+  const unsigned char* data = release? nullptr : image.LevelPointer(i);
+  GLState::Get().PixelStore(GL_UNPACK_ALIGNMENT, 1);
+  if(const int channels = UncompressedChannels(image.format))
+    glTexImage2D(GL_TEXTURE_2D, i, image.format, width, height, 0, PixelFormatForChannels(channels), GL_UNSIGNED_BYTE, data);
+  else glCompressedTexImage2D(GL_TEXTURE_2D, i, image.format, width, height, 0, release? 0 : level.size, data);
+  GLState::Get().PixelStore(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// first level whose larger side fits residentSize, the part of a streamed chain that is always uploaded
+size_t StreamingBaseLevel(const DecodedImage& image, int residentSize){
+  size_t level = 0;
+  while(level + 1 < image.levels.size() && std::max(image.levels[level].width, image.levels[level].height) > residentSize) level++;
+  return level;
+}
+
+// baseLevel > 0 leaves the finer levels unspecified for the TextureStreamer to fill in later. every
+// source is baked first, an image without a chain (a failed decode) gets a texture without storage
+unsigned int UploadTexture(const DecodedImage& image, size_t baseLevel = 0){
+  unsigned int texid;
+  glGenTextures(1, &texid);
+  GLState::Get().BindTextureForUpdate(GL_TEXTURE_2D, texid);
+
+  if(image.format){
+    // baked chains upload level by level, no driver-side mip generation
+    for(size_t i = baseLevel; i < image.levels.size(); i++)
+      UploadTextureLevel(image, i);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, baseLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels.size() - 1);
+    if(image.grey) SetGreySwizzle(GL_TEXTURE_2D, image.format);
+  }
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  return texid;
+}
+
+// keeps the finest levels of streamed textures resident only while something on screen needs them.
+// each texture's resident chain is [base, last], exposed to sampling through GL_TEXTURE_BASE_LEVEL.
+// GL thread only
+class TextureStreamer{
+private:
+  struct Entry{
+    std::shared_ptr<const DecodedImage> image;
+    size_t base;
+    size_t floor;
+    size_t wanted;
+    uint64_t lastUsed;
+  };
+
+  std::unordered_map<unsigned int, Entry> mEntries;
+  size_t mBudget = (size_t)512 << 20;
+  size_t mUploadBudget = (size_t)16 << 20;
+  size_t mResident = 0;
+  uint64_t mFrame = 1;
+
+  void SetBase(unsigned int id, Entry& entry, size_t base){
+    GLState::Get().BindTextureForUpdate(GL_TEXTURE_2D, id);
+    if(base < entry.base){
+      for(size_t level = base; level < entry.base; level++) UploadTextureLevel(*entry.image, level);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+      mResident += entry.image->LevelRangeBytes(base) - entry.image->LevelRangeBytes(entry.base);
+    }
+    else{
+      // stop sampling the levels before releasing them
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+      for(size_t level = entry.base; level < base; level++) UploadTextureLevel(*entry.image, level, true);
+      mResident -= entry.image->LevelRangeBytes(entry.base) - entry.image->LevelRangeBytes(base);
+    }
+    entry.base = base;
+  }
+
+  // frees levels nobody needs right now, least recently used textures first, until bytes fit the budget
+  bool Evict(size_t bytes, unsigned int keep){
+    std::vector<std::pair<unsigned int, Entry*>> victims;
+    for(auto& it: mEntries){
+      Entry& entry = it.second;
+      const size_t keepLevel = (entry.lastUsed == mFrame)? std::min(entry.wanted, entry.floor) : entry.floor;
+      if(it.first != keep && entry.base < keepLevel) victims.push_back({it.first, &entry});
+    }
+    std::sort(victims.begin(), victims.end(), [](const std::pair<unsigned int, Entry*>& a, const std::pair<unsigned int, Entry*>& b){
+      return a.second->lastUsed < b.second->lastUsed;
+    });
+
+    for(auto& victim: victims){
+      Entry& entry = *victim.second;
+      const size_t keepLevel = (entry.lastUsed == mFrame)? std::min(entry.wanted, entry.floor) : entry.floor;
+      while(entry.base < keepLevel && mResident + bytes > mBudget) SetBase(victim.first, entry, entry.base + 1);
+      if(mResident + bytes <= mBudget) return true;
+    }
+    return mResident + bytes <= mBudget;
+  }
+
+public:
+  static TextureStreamer& Get(){
+    static TextureStreamer streamer;
+    return streamer;
+  }
+
+  void SetBudget(size_t bytes) {mBudget = bytes;}
+  void SetUploadBudget(size_t bytes) {mUploadBudget = bytes;}
+  size_t GetResidentBytes() const {return mResident;}
+
+  // image must hold the whole chain, the texture already has [base, last] uploaded
+  void Add(unsigned int id, std::shared_ptr<const DecodedImage> image, size_t base){
+    if(!image || image->levels.empty() || mEntries.count(id)) return;
+    Entry entry = {image, base, base, base, 0};
+    mResident += image->LevelRangeBytes(base);
+    mEntries.emplace(id, std::move(entry));
+  }
+
+  void Remove(unsigned int id){
+    auto it = mEntries.find(id);
+    if(it == mEntries.end()) return;
+    mResident -= it->second.image->LevelRangeBytes(it->second.base);
+    mEntries.erase(it);
+  }
+
+  // screenPixels is how many pixels the texture spans on screen this frame, assuming its UVs cover
+  // the mesh once; the finest request of the frame wins
+  void Request(unsigned int id, float screenPixels){
+    auto it = mEntries.find(id);
+    if(it == mEntries.end()) return;
+    Entry& entry = it->second;
+    const DecodedImage::Level& top = entry.image->levels[0];
+    const float texels = (float)std::max(top.width, top.height);
+    const float ratio = texels / std::max(screenPixels, 1.0f);
+    const size_t level = std::min(entry.floor, (size_t)std::max(0.0f, std::floor(std::log2(std::max(ratio, 1.0f)))));
+    if(entry.lastUsed != mFrame){
+      entry.lastUsed = mFrame;
+      entry.wanted = level;
+    }
+    else entry.wanted = std::min(entry.wanted, level);
+  }
+
+  // once per frame after drawing: streams in one level per texture that needs finer mips, largest
+  // deficit first, within the per-frame upload budget and the residency budget
+  void Update(){
+    std::vector<std::pair<unsigned int, Entry*>> pending;
+    for(auto& it: mEntries)
+      if(it.second.lastUsed == mFrame && it.second.wanted < it.second.base) pending.push_back({it.first, &it.second});
+    std::sort(pending.begin(), pending.end(), [](const std::pair<unsigned int, Entry*>& a, const std::pair<unsigned int, Entry*>& b){
+      return a.second->base - a.second->wanted > b.second->base - b.second->wanted;
+    });
+
+    size_t spent = 0;
+    for(auto& item: pending){
+      Entry& entry = *item.second;
+      const size_t bytes = entry.image->levels[entry.base - 1].size;
+      if(spent > 0 && spent + bytes > mUploadBudget) break;
+      if(mResident + bytes > mBudget && !Evict(bytes, item.first)) break;
+      SetBase(item.first, entry, entry.base - 1);
+      spent += bytes;
+    }
+
+    // hand back levels that are no longer needed once the budget is tight again
+    if(mResident > mBudget) Evict(0, 0);
+    GLState::Get().BindTexture(TEXTURE_UPLOAD_UNIT, GL_TEXTURE_2D, 0);
+    mFrame++;
+  }
+};
+
+// one GL_TEXTURE_2D_ARRAY per distinct format, size and mip count, every baked map of that shape is a
+// layer of it. the arrays stay bound to TEXTURE_ARRAY_UNIT + slot and shaders reach them through the
+// MaterialTable, so draws bind no textures. layers are recycled once their TextureResource is gone
+class TextureArrayPool{
+private:
+  struct Array{
+    GLenum format;
+    bool grey;
+    int width;
+    int height;
+    int levels;
+    unsigned int id;
+    int capacity;
+    int used;
+    std::vector<int> freeLayers;
+  };
+
+  std::vector<Array> mArrays;
+
+  static unsigned int Allocate(const Array& array, int capacity){
+    unsigned int id;
+    glGenTextures(1, &id);
+    GLState::Get().BindTextureForUpdate(GL_TEXTURE_2D_ARRAY, id);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levels, array.format, array.width, array.height, capacity);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if(array.grey) SetGreySwizzle(GL_TEXTURE_2D_ARRAY, array.format);
+    return id;
+  }
+
+  // doubles the layer count, existing layers are copied on the GPU
+  bool Grow(Array& array){
+    int maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if(array.capacity * 2 > maxLayers) return false;
+
+    const unsigned int id = Allocate(array, array.capacity * 2);
+    for(int level = 0; level < array.levels; level++)
+      glCopyImageSubData(array.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, id, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                         std::max(array.width >> level, 1), std::max(array.height >> level, 1), array.used);
+    GLState::Get().DeleteTexture(array.id);
+    array.id = id;
+    array.capacity *= 2;
+    return true;
+  }
+
+public:
+  static TextureArrayPool& Get(){
+    static TextureArrayPool pool;
+    return pool;
+  }
+
+  // uploads a baked chain into a free layer. false for unbaked images, when MAX_TEXTURE_ARRAYS
+  // shapes are already in use or the array is full, the caller then uploads a texture of its own
+  bool Insert(const DecodedImage& image, int& slot, int& layer){
+    if(!image.format || image.levels.empty()) return false;
+
+    const int levels = image.levels.size();
+    auto it = std::find_if(mArrays.begin(), mArrays.end(), [&](const Array& a){
+      return a.format == image.format && a.grey == image.grey && a.width == image.width && a.height == image.height && a.levels == levels;
+    });
+    if(it == mArrays.end()){
+      if(mArrays.size() >= MAX_TEXTURE_ARRAYS) return false;
+      Array array = {image.format, image.grey, image.width, image.height, levels, 0, 4, 0, {}};
+      array.id = Allocate(array, array.capacity);
+      mArrays.push_back(array);
+      it = mArrays.end() - 1;
+    }
+
+    Array& array = *it;
+    if(!array.freeLayers.empty()){
+      layer = array.freeLayers.back();
+      array.freeLayers.pop_back();
+    }
+    else{
+      if(array.used == array.capacity && !Grow(array)) return false;
+      layer = array.used++;
+    }
+    slot = it - mArrays.begin();
+
+    GLState::Get().BindTextureForUpdate(GL_TEXTURE_2D_ARRAY, array.id);
+    GLState::Get().PixelStore(GL_UNPACK_ALIGNMENT, 1);
+    for(int i = 0; i < levels; i++){
+      const DecodedImage::Level& level = image.levels[i];
+      if(const int channels = UncompressedChannels(image.format))
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, PixelFormatForChannels(channels), GL_UNSIGNED_BYTE, image.LevelPointer(i));
+      else glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, image.format, level.size, image.LevelPointer(i));
+    }
+    GLState::Get().PixelStore(GL_UNPACK_ALIGNMENT, 4);
+    return true;
+  }
+
+  void Release(int slot, int layer){mArrays[slot].freeLayers.push_back(layer);}
+
+  // deletes the arrays while the context is current, after every texture placed in them is gone
+  void Shutdown(){
+    for(auto& array: mArrays) GLState::Get().DeleteTexture(array.id);
+    mArrays.clear();
+  }
+
+  // once per frame, Grow replaces array textures
+  void Bind() const{
+    for(size_t i = 0; i < mArrays.size(); i++)
+      GLState::Get().BindTexture(TEXTURE_ARRAY_UNIT + i, GL_TEXTURE_2D_ARRAY, mArrays[i].id);
+  }
+};
+
+TextureResource::~TextureResource(){
+  if(mArray >= 0) TextureArrayPool::Get().Release(mArray, mLayer);
+  else{
+    TextureStreamer::Get().Remove(mId);
+    GLState::Get().DeleteTexture(mId);
+  }
+  TextureCache::Get().Remove(mKey);
+}
+
+// std430 mirror of one entry of the shader's material buffer:
+//   struct Material{vec4 baseColor; float roughness; float metallic; ivec4 arrays; ivec4 layers;};
+//   layout(std430, binding = 2) readonly buffer Materials{Material materials[];};
+// arrays and layers place the diffuse, specular, normal and orm maps in the TextureArrayPool, -1 for
+// maps the mesh lacks or that did not fit an array. a draw's index arrives as integer attribute 6
+struct MaterialData{
+  glm::vec4 baseColor;
+  float roughness;
+  float metallic;
+  float padding[2];
+  glm::ivec4 arrays;
+  glm::ivec4 layers;
+};
+static_assert(offsetof(MaterialData, roughness) == 16 && offsetof(MaterialData, arrays) == 32 &&
+              offsetof(MaterialData, layers) == 48 && sizeof(MaterialData) == 64, "MaterialData must follow std430");
+
+// every material in use, in one shader storage buffer indexed per draw. identical materials share an
+// entry and entries are never removed. GL thread only
+class MaterialTable{
+private:
+  std::vector<MaterialData> mMaterials;
+  std::unordered_map<uint64_t, uint32_t> mLookup;
+  unsigned int mBuffer;
+  size_t mCapacity;
+  bool mDirty;
+
+  MaterialTable(): mBuffer(0), mCapacity(0), mDirty(false){}
+
+public:
+  static MaterialTable& Get(){
+    static MaterialTable table;
+    return table;
+  }
+
+  uint32_t Add(const MaterialData& material){
+    const uint64_t hash = HashBytes(&material, sizeof(material));
+    auto it = mLookup.find(hash);
+    if(it != mLookup.end() && memcmp(&mMaterials[it->second], &material, sizeof(material)) == 0) return it->second;
+    mMaterials.push_back(material);
+    mLookup[hash] = mMaterials.size() - 1;
+    mDirty = true;
+    return mMaterials.size() - 1;
+  }
+
+  void Shutdown(){
+    GLState::Get().DeleteBuffer(mBuffer);
+    mBuffer = 0;
+    mCapacity = 0;
+    mMaterials.clear();
+    mLookup.clear();
+    mDirty = false;
+  }
+
+  // uploads the table when it changed and binds it, once per frame before drawing
+  void Bind(){
+    if(mDirty){
+      if(!mBuffer) glGenBuffers(1, &mBuffer);
+      GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffer);
+      if(mMaterials.size() > mCapacity){
+        mCapacity = std::max(mCapacity * 2, std::max(mMaterials.size(), (size_t)64));
+        glBufferData(GL_SHADER_STORAGE_BUFFER, mCapacity * sizeof(MaterialData), nullptr, GL_DYNAMIC_DRAW);
+      }
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mMaterials.size() * sizeof(MaterialData), mMaterials.data());
+      mDirty = false;
+    }
+    if(mBuffer) GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, mBuffer);
+  }
+};
+
+// first-fit allocator over [0, capacity) in elements, neighbouring free blocks are merged on Free
+class RangeAllocator{
+private:
+  std::map<size_t, size_t> mFree;
+  size_t mCapacity = 0;
+
+public:
+  static constexpr size_t INVALID = SIZE_MAX;
+
+  size_t Capacity() const {return mCapacity;}
+
+  void Grow(size_t capacity){
+    if(capacity <= mCapacity) return;
+    Free(mCapacity, capacity - mCapacity);
+    mCapacity = capacity;
+  }
+
+  size_t Allocate(size_t size){
+    for(auto it = mFree.begin(); it != mFree.end(); ++it){
+      if(it->second < size) continue;
+      const size_t offset = it->first;
+      const size_t rest = it->second - size;
+      mFree.erase(it);
+      if(rest) mFree[offset + size] = rest;
+      return offset;
+    }
+    return INVALID;
+  }
+
+  void Free(size_t offset, size_t size){
+    if(!size) return;
+    auto next = mFree.lower_bound(offset);
+    if(next != mFree.begin()){
+      auto prev = std::prev(next);
+      if(prev->first + prev->second == offset){
+        offset = prev->first;
+        size += prev->second;
+        mFree.erase(prev);
+      }
+    }
+    if(next != mFree.end() && offset + size == next->first){
+      size += next->second;
+      mFree.erase(next);
+    }
+    mFree[offset] = size;
+  }
+};
+
+// layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand{
+  uint32_t count;
+  uint32_t instanceCount;
+  uint32_t firstIndex;
+  int32_t baseVertex;
+  uint32_t baseInstance;
+};
+
+// per-draw vertex attributes 3-6, instanced with divisor 1 and selected through baseInstance
+struct DrawParams{
+  glm::vec3 positionScale;
+  glm::vec3 positionOffset;
+  // 1 when attribute 1 holds an octahedral normal (the packed format)
+  uint32_t octNormals;
+  uint32_t material;
+};
+
+class GeometryPool;
+
+// a mesh's slice of a GeometryPool, handed back to the pool when destroyed
+class PoolAllocation{
+private:
+  GeometryPool* mPool = nullptr;
+
+public:
+  size_t vertexOffset = 0;
+  size_t vertexCount = 0;
+  size_t indexOffset = 0;
+  size_t indexCount = 0;
+
+  PoolAllocation() = default;
+  PoolAllocation(GeometryPool* pool): mPool(pool) {}
+  ~PoolAllocation();
+
+  PoolAllocation(const PoolAllocation&) = delete;
+  PoolAllocation(PoolAllocation&& other) noexcept{*this = std::move(other);}
+  PoolAllocation& operator=(PoolAllocation&& other) noexcept;
+
+  GeometryPool* GetPool() const {return mPool;}
+};
+
+// one vertex buffer, one 32-bit index buffer and one VAO per vertex format, shared by every model that
+// opts in, so all their meshes can go out in a few glMultiDrawElementsIndirect calls
+class GeometryPool{
+private:
+  VertexFormat mFormat;
+  VAO mVao;
+  VBO mVbo;
+  EBO mEbo;
+  VBO mParams;
+  unsigned int mIndirect;
+  RangeAllocator mVertexSpace;
+  RangeAllocator mIndexSpace;
+  std::vector<uint32_t> mWiden;
+
+  GeometryPool(VertexFormat format): mFormat(format){
+    glGenBuffers(1, &mIndirect);
+    Reserve(1 << 16, 1 << 18);
+  }
+
+  static void CopyBuffer(unsigned int from, unsigned int to, size_t size){
+    if(!size) return;
+    GLState::Get().BindBuffer(GL_COPY_READ_BUFFER, from);
+    GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, to);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+  }
+
+  // grows by at least doubling and copies the old contents, so existing allocations keep their offsets
+  void Reserve(size_t vertices, size_t indices){
+    mVao.Unbind();
+    const size_t stride = VertexStride(mFormat);
+
+    if(vertices > mVertexSpace.Capacity()){
+      const size_t capacity = std::max(vertices, mVertexSpace.Capacity() * 2);
+      VBO vbo;
+      vbo.Bind();
+      vbo.AllocateMem(capacity * stride, GL_STATIC_DRAW);
+      CopyBuffer(mVbo.GetId(), vbo.GetId(), mVertexSpace.Capacity() * stride);
+      mVbo = std::move(vbo);
+      mVertexSpace.Grow(capacity);
+    }
+
+    if(indices > mIndexSpace.Capacity()){
+      const size_t capacity = std::max(indices, mIndexSpace.Capacity() * 2);
+      EBO ebo;
+      ebo.Bind();
+      ebo.AllocateMem(capacity * sizeof(uint32_t), GL_STATIC_DRAW);
+      CopyBuffer(mEbo.GetId(), ebo.GetId(), mIndexSpace.Capacity() * sizeof(uint32_t));
+      mEbo = std::move(ebo);
+      mIndexSpace.Grow(capacity);
+    }
+
+    mVao.Bind();
+    mVbo.Bind();
+    mEbo.Bind();
+    if(mFormat == VertexFormat::Packed){
+      mVao.SetAttrib(0, 3, stride, offsetof(PackedVertex, position), GL_UNSIGNED_SHORT, true);
+      mVao.SetAttrib(1, 2, stride, offsetof(PackedVertex, normal), GL_SHORT, true);
+      mVao.SetAttrib(2, 2, stride, offsetof(PackedVertex, texcoord), GL_HALF_FLOAT);
+    }
+    else{
+      mVao.SetAttrib(0, 3, stride, offsetof(Vertex, position));
+      mVao.SetAttrib(1, 3, stride, offsetof(Vertex, normal));
+      mVao.SetAttrib(2, 2, stride, offsetof(Vertex, texcoord));
+    }
+    mParams.Bind();
+    mVao.SetAttrib(3, 3, sizeof(DrawParams), offsetof(DrawParams, positionScale));
+    mVao.SetAttrib(4, 3, sizeof(DrawParams), offsetof(DrawParams, positionOffset));
+    mVao.SetIntAttrib(5, 1, sizeof(DrawParams), offsetof(DrawParams, octNormals));
+    mVao.SetIntAttrib(6, 1, sizeof(DrawParams), offsetof(DrawParams, material));
+    glVertexAttribDivisor(3, 1);
+    glVertexAttribDivisor(4, 1);
+    glVertexAttribDivisor(5, 1);
+    glVertexAttribDivisor(6, 1);
+    mVao.Unbind();
+  }
+
+  static size_t AllocateFrom(RangeAllocator& space, size_t count, const std::function<void(size_t)>& grow){
+    size_t offset = space.Allocate(count);
+    if(offset == RangeAllocator::INVALID){
+      grow(space.Capacity() + count);
+      offset = space.Allocate(count);
+    }
+    return offset;
+  }
+
+public:
+  ~GeometryPool(){GLState::Get().DeleteBuffer(mIndirect);}
+
+  GeometryPool(const GeometryPool&) = delete;
+  GeometryPool& operator=(const GeometryPool&) = delete;
+
+private:
+  static std::unique_ptr<GeometryPool>& Slot(VertexFormat format){
+    static std::unique_ptr<GeometryPool> pools[2];
+    return pools[format == VertexFormat::Packed];
+  }
+
+public:
+  static GeometryPool& Get(VertexFormat format){
+    std::unique_ptr<GeometryPool>& pool = Slot(format);
+    if(!pool) pool.reset(new GeometryPool(format));
+    return *pool;
+  }
+
+  // frees the pools' buffers while the context is current, after every mesh allocated from them is gone
+  static void Shutdown(){
+    Slot(VertexFormat::Float).reset();
+    Slot(VertexFormat::Packed).reset();
+  }
+
+  // copies the view's vertices and indices into the shared buffers, 16-bit indices are widened
+  PoolAllocation Allocate(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount, GLenum indexType){
+    PoolAllocation allocation(this);
+    allocation.vertexCount = vertexCount;
+    allocation.indexCount = indexCount;
+    allocation.vertexOffset = AllocateFrom(mVertexSpace, vertexCount, [this](size_t n){Reserve(n, 0);});
+    allocation.indexOffset = AllocateFrom(mIndexSpace, indexCount, [this](size_t n){Reserve(0, n);});
+
+    const size_t stride = VertexStride(mFormat);
+    mVao.Unbind();
+    mVbo.Bind();
+    mVbo.FillMem(allocation.vertexOffset * stride, vertexCount * stride, vertices);
+
+    const void* data = indices;
+    if(indexType == GL_UNSIGNED_SHORT){
+      const uint16_t* shorts = static_cast<const uint16_t*>(indices);
+      mWiden.assign(shorts, shorts + indexCount);
+      data = mWiden.data();
+    }
+    mEbo.Bind();
+    mEbo.FillMem(allocation.indexOffset * sizeof(uint32_t), indexCount * sizeof(uint32_t), data);
+    return allocation;
+  }
+
+  void Free(const PoolAllocation& allocation){
+    mVertexSpace.Free(allocation.vertexOffset, allocation.vertexCount);
+    mIndexSpace.Free(allocation.indexOffset, allocation.indexCount);
+  }
+
+  // uploads one frame's commands and per-draw params, DrawRange addresses them by index
+  void Upload(const std::vector<DrawElementsIndirectCommand>& commands, const std::vector<DrawParams>& params){
+    GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirect);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+    mParams.Bind();
+    mParams.AllocateAndFillMem(params.size() * sizeof(DrawParams), params.data(), GL_STREAM_DRAW);
+  }
+
+  // binds the shared VAO and the uploaded commands for DrawRange calls
+  void BeginDraws(){
+    mVao.Bind();
+    GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirect);
+  }
+
+  void DrawRange(size_t first, size_t count){
+    if(!count) return;
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+  }
+
+  void EndDraws(){
+    mVao.Unbind();
+  }
+};
+
+PoolAllocation::~PoolAllocation(){
+  if(mPool) mPool->Free(*this);
+}
+
+PoolAllocation& PoolAllocation::operator=(PoolAllocation&& other) noexcept{
+  if(this != &other){
+    if(mPool) mPool->Free(*this);
+    mPool = other.mPool;
+    vertexOffset = other.vertexOffset;
+    vertexCount = other.vertexCount;
+    indexOffset = other.indexOffset;
+    indexCount = other.indexCount;
+    other.mPool = nullptr;
+  }
+  return *this;
+}
+
+// binds each map to the unit its material.texture_<type><n> sampler was given at link time
+void BindTextures(const std::vector<Texture>& textures){
+  unsigned int diffuseNr = 1;
+  unsigned int specularNr = 1;
+  for(auto& texture: textures){
+    // array layers are reached through the material table
+    if(texture.id == 0) continue;
+    unsigned int number = 1;
+    if(texture.type == "texture_diffuse") number = diffuseNr++;
+    else if(texture.type == "texture_specular") number = specularNr++;
+
+    const int unit = TextureUnit(texture.type, number);
+    if(unit < 0) continue;
+    GLState::Get().BindTexture(unit, GL_TEXTURE_2D, texture.id);
+  }
+}
+
+// identifies what BindTextures would bind, so meshes whose maps all live in arrays share one key
+uint64_t TextureSetKey(const std::vector<Texture>& textures){
+  uint64_t key = 0;
+  for(auto& texture: textures){
+    if(texture.id == 0) continue;
+    key = HashBytes(texture.type.data(), texture.type.size(), key);
+    key = HashBytes(&texture.id, sizeof(texture.id), key);
+  }
+  return key;
+}
+
+class Mesh{
+private:  
+  // a mesh either owns its buffers or lives in a shared GeometryPool
+  std::unique_ptr<VBO> mVbo;
+  std::unique_ptr<EBO> mEbo;
+  std::unique_ptr<VAO> mVao;
+  PoolAllocation mAllocation;
+  size_t mIndexCount;
+  GLenum mIndexType;
+  VertexFormat mFormat;
+  glm::vec3 mBoundsMin;
+  glm::vec3 mBoundsMax;
+  uint32_t mMaterial = 0;
+  bool mTranslucent = false;
+  uint64_t mTextureKey = 0;
+  std::vector<MeshLod> mLods;
+  std::vector<Meshlet> mMeshlets;
+  std::vector<uint32_t> mRangeFirst;
+  std::vector<GLsizei> mRangeCount;
+  std::vector<const void*> mDrawOffsets;
+
+  void SetupMesh(const MeshView& view, GeometryPool* pool){
+    mIndexCount = view.indexCount;
+    mIndexType = view.indexType;
+    mFormat = view.format;
+    mBoundsMin = view.boundsMin;
+    mBoundsMax = view.boundsMax;
+    if(view.lodCount) mLods.assign(view.lods, view.lods + view.lodCount);
+    else mLods.assign(1, {0, (uint32_t)view.indexCount, 0.0f});
+    mMeshlets.assign(view.meshlets, view.meshlets + view.meshletCount);
+
+    if(pool){
+      mAllocation = pool->Allocate(view.vertices, view.vertexCount, view.indices, view.indexCount, mIndexType);
+      return;
+    }
+
+    const size_t stride = VertexStride(mFormat);
+    mVbo.reset(new VBO());
+    mEbo.reset(new EBO());
+    mVao.reset(new VAO());
+
+    mVao->Bind();
+    mVbo->Bind();
+    mVbo->AllocateAndFillMem(view.vertexCount * stride, view.vertices, GL_STATIC_DRAW);
+    mEbo->Bind();
+    mEbo->AllocateAndFillMem(view.indexCount * IndexStride(mIndexType), view.indices, GL_STATIC_DRAW);
+    if(mFormat == VertexFormat::Packed){
+      mVao->SetAttrib(0, 3, stride, offsetof(PackedVertex, position), GL_UNSIGNED_SHORT, true);
+      mVao->SetAttrib(1, 2, stride, offsetof(PackedVertex, normal), GL_SHORT, true);
+      mVao->SetAttrib(2, 2, stride, offsetof(PackedVertex, texcoord), GL_HALF_FLOAT);
+    }
+    else{
+      mVao->SetAttrib(0, 3, stride, offsetof(Vertex, position));
+      mVao->SetAttrib(1, 3, stride, offsetof(Vertex, normal));
+      mVao->SetAttrib(2, 2, stride, offsetof(Vertex, texcoord));
+    }
+
+    mVao->Unbind();
+  }
+
+  // fills mRangeFirst/mRangeCount with the index ranges to draw, false when nothing is visible
+  bool CollectRanges(size_t lod, const CullContext* cull){
+    lod = std::min(lod, mLods.size() - 1);
+    mRangeFirst.clear();
+    mRangeCount.clear();
+
+    if(cull){
+      const glm::vec3 center = (mBoundsMin + mBoundsMax) * 0.5f;
+      if(!cull->IsSphereVisible(center, glm::length(mBoundsMax - mBoundsMin) * 0.5f)) return false;
+    }
+
+    if(cull && lod == 0 && !mMeshlets.empty()){
+      uint32_t runStart = 0;
+      uint32_t runEnd = 0;
+      for(auto& meshlet: mMeshlets){
+        if(!cull->IsMeshletVisible(meshlet)) continue;
+        if(meshlet.indexOffset != runEnd){
+          if(runEnd > runStart){
+            mRangeFirst.push_back(runStart);
+            mRangeCount.push_back(runEnd - runStart);
+          }
+          runStart = meshlet.indexOffset;
+        }
+        runEnd = meshlet.indexOffset + meshlet.indexCount;
+      }
+      if(runEnd > runStart){
+        mRangeFirst.push_back(runStart);
+        mRangeCount.push_back(runEnd - runStart);
+      }
+    }
+    else{
+      mRangeFirst.push_back(mLods[lod].indexOffset);
+      mRangeCount.push_back(mLods[lod].indexCount);
+    }
+    return !mRangeCount.empty();
+  }
+
+public:
+  std::vector<Vertex> mVertices;
+  std::vector<unsigned int> mIndices;
+  std::vector<Texture> mTextures;
+  
+  Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures){
+    mVertices = std::move(vertices);
+    mIndices = std::move(indices);
+    mTextures = std::move(textures);
+    mTextureKey = TextureSetKey(mTextures);
+
+    MeshView view;
+    view.vertices = mVertices.data();
+    view.vertexCount = mVertices.size();
+    view.indices = mIndices.data();
+    view.indexCount = mIndices.size();
+    ComputeBounds(mVertices.data(), mVertices.size(), view.boundsMin, view.boundsMax);
+    SetupMesh(view, nullptr);
+  }
+
+  // uploads straight from caller memory (e.g. a mapped cache file) without keeping a CPU copy,
+  // into its own buffers or into pool
+  Mesh(const MeshView& view, const std::vector<Texture>& textures, GeometryPool* pool = nullptr){
+    mTextures = textures;
+    mTextureKey = TextureSetKey(mTextures);
+    SetupMesh(view, pool);
+  }
+
+  Mesh(Mesh&&) = default;
+  Mesh& operator=(Mesh&&) = default;
+  ~Mesh()=default;
+
+  // coarsest LOD whose error projects to at most maxPixelError on screen. pixelScale is
+  // projection[1][1] * viewport height / 2, i.e. pixels per model unit at distance 1
+  size_t SelectLod(const glm::mat4& model, const glm::vec3& cameraPos, float pixelScale, float maxPixelError) const{
+    if(mLods.size() == 1) return 0;
+
+    const glm::vec3 center = glm::vec3(model * glm::vec4((mBoundsMin + mBoundsMax) * 0.5f, 1.0f));
+    const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    const float radius = glm::length(mBoundsMax - mBoundsMin) * 0.5f * scale;
+    const float distance = std::max(glm::length(cameraPos - center) - radius, 1e-3f);
+
+    size_t lod = 0;
+    for(size_t i = 1; i < mLods.size(); i++){
+      if(mLods[i].error * scale * pixelScale / distance > maxPixelError) break;
+      lod = i;
+    }
+    return lod;
+  }
+
+  size_t GetLodCount() const {return mLods.size();}
+
+  // projected diameter of the bounds in pixels, 0 when the bounds are outside the frustum
+  float ScreenSize(const glm::mat4& model, const glm::vec3& cameraPos, float pixelScale, const CullContext& cull) const{
+    const glm::vec3 localCenter = (mBoundsMin + mBoundsMax) * 0.5f;
+    const float localRadius = glm::length(mBoundsMax - mBoundsMin) * 0.5f;
+    if(!cull.IsSphereVisible(localCenter, localRadius)) return 0.0f;
+
+    const glm::vec3 center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+    const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    const float distance = std::max(glm::length(cameraPos - center) - localRadius * scale, 1e-3f);
+    return 2.0f * localRadius * scale * pixelScale / distance;
+  }
+
+  GeometryPool* GetPool() const {return mAllocation.GetPool();}
+
+  glm::vec3 GetCenter() const {return (mBoundsMin + mBoundsMax) * 0.5f;}
+  float GetRadius() const {return glm::length(mBoundsMax - mBoundsMin) * 0.5f;}
+  uint64_t GetTextureKey() const {return mTextureKey;}
+
+  // index into the MaterialTable, carried to the shader with the draw parameters. translucent
+  // meshes are drawn after the opaque ones, back to front
+  void SetMaterial(uint32_t material, bool translucent){
+    mMaterial = material;
+    mTranslucent = translucent;
+  }
+  bool IsTranslucent() const {return mTranslucent;}
+
+  // packed positions are unorm inside the mesh bounds and packed normals octahedral, float ones pass
+  // through unchanged
+  DrawParams GetDrawParams() const{
+    const bool packed = (mFormat == VertexFormat::Packed);
+    return {packed? mBoundsMax - mBoundsMin : glm::vec3(1.0f), packed? mBoundsMin : glm::vec3(0.0f), packed? 1u : 0u, mMaterial};
+  }
+
+  // pooled meshes only: appends one indirect command per visible range, all sharing one DrawParams
+  void AppendDraws(std::vector<DrawElementsIndirectCommand>& commands, std::vector<DrawParams>& params, size_t lod = 0, const CullContext* cull = nullptr){
+    if(!GetPool() || !CollectRanges(lod, cull)) return;
+    const uint32_t instance = params.size();
+    params.push_back(GetDrawParams());
+    for(size_t i = 0; i < mRangeCount.size(); i++)
+      commands.push_back({(uint32_t)mRangeCount[i], 1, (uint32_t)(mAllocation.indexOffset + mRangeFirst[i]), (int32_t)mAllocation.vertexOffset, instance});
+  }
+
+  // with a cull context the whole mesh is frustum tested, and LOD 0 only submits the meshlets that survive
+  // frustum and normal cone culling, merged into as few ranges as possible. the program and textures are
+  // the caller's, pooled meshes are drawn through their pool with AppendDraws instead
+  void Draw(size_t lod = 0, const CullContext* cull = nullptr){
+    if(GetPool() || !CollectRanges(lod, cull)) return;
+
+    mDrawOffsets.clear();
+    for(uint32_t first: mRangeFirst)
+      mDrawOffsets.push_back((const void*)((size_t)first * IndexStride(mIndexType)));
+
+    // attributes 3-6 are disabled on a mesh's own VAO, so the current generic values apply
+    const DrawParams params = GetDrawParams();
+    glVertexAttrib3fv(3, glm::value_ptr(params.positionScale));
+    glVertexAttrib3fv(4, glm::value_ptr(params.positionOffset));
+    glVertexAttribI1ui(5, params.octNormals);
+    glVertexAttribI1ui(6, params.material);
+
+    mVao->Bind();
+    if(mRangeCount.size() == 1) glDrawElements(GL_TRIANGLES, mRangeCount[0], mIndexType, mDrawOffsets[0]);
+    else glMultiDrawElements(GL_TRIANGLES, mRangeCount.data(), mIndexType, mDrawOffsets.data(), mRangeCount.size());
+    mVao->Unbind();
+  }
+};
+
+class Camera{
+private:
+  glm::vec3 mPosition;
+  glm::vec3 mFront;
+  glm::vec3 mUp;
+
+  float mYaw;
+  float mPitch;
+  float mFov;
+
+  float mSpeed;
+  float mSensitivity;
+
+  float mLastX;
+  float mLastY;
+
+  bool mFirstMouse;
+  
+  glm::mat4 mViewMatrix;
+  glm::mat4 mProjectionMatrix;
+  
+  void UpdateMovement(float dt){
+    if(IsKeyPressed(GLFW_KEY_W)) mPosition += mSpeed * dt * mFront;
+    if(IsKeyPressed(GLFW_KEY_S)) mPosition -= mSpeed * dt * mFront;
+    if(IsKeyPressed(GLFW_KEY_A)) mPosition -= mSpeed * dt * glm::normalize(glm::cross(mFront, mUp));
+    if(IsKeyPressed(GLFW_KEY_D)) mPosition += mSpeed * dt * glm::normalize(glm::cross(mFront, mUp));
+    if(IsKeyPressed(GLFW_KEY_LEFT_SHIFT)) mSpeed = 10.0f;
+    else mSpeed = 6.0f;
+  }
+
+public:
+  Camera(float speed, float sensitivity): mSpeed(speed), mSensitivity(sensitivity){
+    mPosition = {0.0f, 0.0f, 3.0f};
+    mFront = {0.0f, 0.0f, -1.0f};
+    mUp = {0.0f, 1.0f, 0.0f};
+
+    mYaw = -90.0f;
+    mPitch = 0.0f;
+    mFov = 45.0f;
+
+    mLastX = 0.0f;
+    mLastY = 0.0f;
+
+    mFirstMouse = true;
+    
+    mViewMatrix = glm::mat4(1.0f);
+    mProjectionMatrix = glm::mat4(1.0f);
+  }
+
+  ~Camera()=default;
+  
+  const glm::vec3& GetPosition() const {return mPosition;}
+  const glm::vec3& GetFront() const {return mFront;}
+  const glm::mat4& GetViewMatrix() const {return mViewMatrix;}
+  const glm::mat4& GetProjectionMatrix() const {return mProjectionMatrix;}
+
+  void SetPosition(const glm::vec3& position) {mPosition = position;}
+  void SetFront(const glm::vec3& front) {mFront = front;}
+
+  void Update(float dt){
+    mViewMatrix = glm::lookAt(mPosition, mPosition + mFront, mUp);
+    mProjectionMatrix = glm::perspective(glm::radians(mFov), (float)WIDTH/(float)HEIGHT, 0.1f, 1000.0f);
+    UpdateMovement(dt);
+  }
+
+  void UpdateMouse(float x, float y){
+    if(mFirstMouse){
+      mLastX = x;
+      mLastY = y;
+      mFirstMouse = false;
+    }
+
+    float xoffset = x - mLastX;
+    float yoffset = mLastY - y;
+
+    xoffset *= mSensitivity;
+    yoffset *= mSensitivity;
+
+    mLastX = x;
+    mLastY = y;
+
+    mYaw += xoffset;
+    mPitch += yoffset;
+
+    if(mPitch > 89.0f) mPitch = 89.0f;
+    if(mPitch < -89.0f) mPitch = -89.0f;
+
+    glm::vec3 direction;
+    direction.x = glm::cos(glm::radians(mYaw)) * glm::cos(glm::radians(mPitch));
+    direction.y = glm::sin(glm::radians(mPitch));
+    direction.z = glm::sin(glm::radians(mYaw)) * glm::cos(glm::radians(mPitch));
+
+    mFront = glm::normalize(direction);
+  }
+
+  void UpdateScroll(float xoffset, float yoffset){
+    mFov -= yoffset;
+
+    if(mFov < 1.0f) mFov = 1.0f;
+    if(mFov > 45.0f) mFov = 45.0f;
+  }
+};
+
+// on-disk layout written after the first import of a model, see Model::SaveCache
+const char MESH_CACHE_MAGIC[4] = {'P','B','R','M'};
+const uint32_t MESH_CACHE_VERSION = 8;
+
+// Assimp post-processing a model is imported with. FastPreview only triangulates and fills in missing
+// normals; Production also welds, drops degenerate and invalid data, merges meshes and materials and
+// reorders for the vertex cache, which costs seconds on large scenes but is cached per profile
+enum class ImportProfile : uint32_t{FastPreview, Production};
+
+unsigned int ImportFlags(ImportProfile profile){
+  if(profile == ImportProfile::FastPreview) return aiProcess_Triangulate | aiProcess_GenNormals;
+  return aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices |
+         aiProcess_ImproveCacheLocality | aiProcess_RemoveRedundantMaterials | aiProcess_OptimizeMeshes |
+         aiProcess_FindDegenerates | aiProcess_FindInvalidData | aiProcess_SortByPType | aiProcess_ValidateDataStructure;
+}
+
+const char* ImportProfileName(ImportProfile profile){
+  return (profile == ImportProfile::FastPreview)? "preview" : "production";
+}
+
+struct ModelSettings{
+  // Assimp post-processing, each profile keeps its own mesh cache next to the model. FastPreview keeps
+  // the flags models were always imported with, Production is opted into
+  ImportProfile importProfile = ImportProfile::FastPreview;
+  // convert aiMeshes and decode textures on the worker pool, only the GL upload stays on the calling thread
+  bool parallelImport = true;
+  // bytes of vertex, index and texel data a streaming model uploads per Draw
+  size_t uploadBudget = 16 * 1024 * 1024;
+  // Packed halves vertex size for fetch-bound meshes, the vertex shader must apply positionScale/positionOffset
+  // and decode octahedral normals when octNormals is set
+  VertexFormat vertexFormat = VertexFormat::Float;
+  // reorder for vertex cache and fetch locality and use 16-bit indices where possible
+  bool optimizeMeshes = true;
+  // additionally sort triangle clusters outward-first to reduce overdraw
+  bool optimizeOverdraw = false;
+  // total levels of detail per mesh including the full one, 1 disables simplification
+  int lodLevels = 4;
+  // stop simplifying once the surface moves by this fraction of the mesh bounds diagonal
+  float lodTargetError = 0.02f;
+  // Draw with a camera picks the coarsest LOD whose error stays under this many pixels
+  float lodPixelError = 1.0f;
+  // split LOD 0 into meshlets that Draw with a camera culls against the frustum
+  bool meshlets = true;
+  // also drop meshlets whose triangles all face away from the camera
+  bool meshletConeCulling = true;
+  // suballocate meshes from the shared GeometryPool and draw them with glMultiDrawElementsIndirect
+  bool sharedGeometry = false;
+  // upload only mips up to streamingResidentSize and let the TextureStreamer bring in finer ones
+  // as meshes get close enough to need them
+  bool streamTextures = false;
+  int streamingResidentSize = 128;
+  // flip images to GL's bottom-up row order for shaders that expect it, the import does not flip UVs
+  bool flipTextures = false;
+  // premultiply colour maps that carry alpha before their mips are built
+  bool premultiplyAlpha = false;
+  // block-compress textures, None keeps them uncompressed. either way the mip chain is baked into .ktc
+  // files next to their source and uploaded from there on later loads. off by default, BC5 normals and
+  // BC4 masks drop channels that shaders written for RGBA maps sample
+  TextureCompression textureCompression = TextureCompression::None;
+  // colour maps in sRGB formats so shading happens in linear light, for use with sRGB output (--srgb)
+  bool srgbTextures = false;
+  // uncompressed normals as RG8 and masks as R8, for shaders that rebuild normal z
+  bool compactTextures = false;
+  // place baked maps in TextureArrayPool layers so draws bind no textures, the shader samples them
+  // through the MaterialTable. array textures are not streamed
+  bool textureArrays = false;
+
+  BakeOptions Bake(TextureUsage usage) const{
+    BakeOptions options;
+    options.compression = textureCompression;
+    options.flip = flipTextures;
+    options.premultiply = premultiplyAlpha && usage == TextureUsage::Color;
+    options.srgb = srgbTextures;
+    options.compact = compactTextures;
+    return options;
+  }
+
+  // settings that change the cached output, a cache written with different ones is rebuilt
+  uint32_t CacheKey() const{
+    uint32_t words[7] = {(uint32_t)vertexFormat, optimizeMeshes, optimizeOverdraw, (uint32_t)lodLevels, 0, meshlets, ImportFlags(importProfile)};
+    memcpy(&words[4], &lodTargetError, sizeof(float));
+    return (uint32_t)HashBytes(words, sizeof(words));
+  }
+
+  // the default settings with profile's flags. FastPreview also skips the import-time mesh work (LODs,
+  // reordering, meshlets) so a model shows up as soon as Assimp has read it
+  static ModelSettings ForProfile(ImportProfile profile){
+    ModelSettings settings;
+    settings.importProfile = profile;
+    if(profile == ImportProfile::FastPreview){
+      settings.optimizeMeshes = false;
+      settings.lodLevels = 1;
+      settings.meshlets = false;
+    }
+    return settings;
+  }
+};
+
+struct MeshCacheHeader{
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceHash;
+  uint64_t sourceSize;
+  uint32_t meshCount;
+  uint32_t settingsKey;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+struct SortEntry{
+  uint64_t key;
+  uint32_t index;
+};
+
+// LSD radix sort on 8-bit digits, stable. the histograms of all digits come from one pass over the
+// keys, and digits every key shares are skipped, so keys differing in few bits sort in few passes
+void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch){
+  if(entries.size() < 2) return;
+  size_t counts[8][256] = {};
+  for(auto& entry: entries)
+    for(int d = 0; d < 8; d++) counts[d][(entry.key >> (d * 8)) & 0xFF]++;
+
+  scratch.resize(entries.size());
+  for(int d = 0; d < 8; d++){
+    const int shift = d * 8;
+    if(counts[d][(entries[0].key >> shift) & 0xFF] == entries.size()) continue;
+    size_t offset = 0;
+    for(size_t& count: counts[d]){
+      const size_t n = count;
+      count = offset;
+      offset += n;
+    }
+    for(auto& entry: entries) scratch[counts[d][(entry.key >> shift) & 0xFF]++] = entry;
+    entries.swap(scratch);
+  }
+}
+
+// collects one frame's draws from every model and submits them in sort key order:
+//   opaque      0 | program 7 | vao 10 | textures 10 | instance 12 | depth 24
+//   translucent 1 | ~depth 24 | program 7 | vao 10 | textures 10 | instance 12
+// so opaque draws are grouped by state and front to back inside a group, translucent ones back to front.
+// state ids are handed out per frame in order of first use and saturate, Flush compares the real state
+// so a saturated id only costs batching. consecutive pooled draws with equal state become one multi-draw
+class RenderQueue{
+private:
+  struct Instance{
+    glm::mat4 model;
+    CullContext cull;
+  };
+
+  struct Packet{
+    Shader* shader;
+    Mesh* mesh;
+    uint32_t instance;
+    uint32_t lod;
+    bool culled;
+  };
+
+  // a run of sorted packets sharing all state. pooled runs address commands of their pool's list,
+  // standalone ones are a single mesh drawn at lod
+  struct Batch{
+    Shader* shader;
+    Mesh* mesh;
+    GeometryPool* pool;
+    uint32_t instance;
+    uint32_t lod;
+    bool culled;
+    size_t first;
+    size_t count;
+  };
+
+  std::vector<Instance> mInstances;
+  std::vector<Packet> mPackets;
+  std::vector<SortEntry> mEntries;
+  std::vector<SortEntry> mScratch;
+  std::vector<Batch> mBatches;
+  std::unordered_map<const void*, uint32_t> mPrograms;
+  std::unordered_map<const void*, uint32_t> mVaos;
+  std::unordered_map<uint64_t, uint32_t> mTextureSets;
+  std::vector<GeometryPool*> mPools;
+  std::vector<std::vector<DrawElementsIndirectCommand>> mCommands;
+  std::vector<std::vector<DrawParams>> mDrawParams;
+  UniformBuffer<ObjectUniforms> mObject;
+  glm::vec3 mCameraPosition;
+
+  template <typename K>
+  static uint64_t StateId(std::unordered_map<K, uint32_t>& ids, const K& key, int bits){
+    const uint32_t id = ids.emplace(key, ids.size()).first->second;
+    return std::min<uint64_t>(id, (1ull << bits) - 1);
+  }
+
+  size_t PoolIndex(GeometryPool* pool){
+    auto it = std::find(mPools.begin(), mPools.end(), pool);
+    if(it != mPools.end()) return it - mPools.begin();
+    mPools.push_back(pool);
+    mCommands.emplace_back();
+    mDrawParams.emplace_back();
+    return mPools.size() - 1;
+  }
+
+  void Clear(){
+    mInstances.clear();
+    mPackets.clear();
+    mEntries.clear();
+    mPrograms.clear();
+    mVaos.clear();
+    mTextureSets.clear();
+  }
+
+public:
+  RenderQueue(): mObject(UNIFORM_BLOCKS[1].binding), mCameraPosition(0.0f){}
+
+  RenderQueue(const RenderQueue&) = delete;
+  RenderQueue& operator=(const RenderQueue&) = delete;
+
+  void Begin(const glm::vec3& cameraPosition){
+    Clear();
+    mCameraPosition = cameraPosition;
+  }
+
+  // the model matrix and cull context shared by the packets of one model
+  uint32_t AddInstance(const glm::mat4& model, const CullContext& cull){
+    mInstances.push_back({model, cull});
+    return mInstances.size() - 1;
+  }
+
+  // culled packets are frustum tested here and again per range when drawn
+  void Add(Shader& shader, Mesh& mesh, uint32_t instance, size_t lod, bool culled){
+    const Instance& owner = mInstances[instance];
+    if(culled && !owner.cull.IsSphereVisible(mesh.GetCenter(), mesh.GetRadius())) return;
+
+    const glm::vec3 center = glm::vec3(owner.model * glm::vec4(mesh.GetCenter(), 1.0f));
+    const float distance = glm::length(mCameraPosition - center);
+    uint32_t bits;
+    memcpy(&bits, &distance, sizeof(bits));
+    // positive floats order like their bit patterns, the top 24 below the sign are kept
+    const uint64_t depth = (bits >> 7) & 0xFFFFFF;
+
+    const uint64_t program = StateId(mPrograms, (const void*)&shader, 7);
+    // standalone meshes own their VAO, pooled ones share their pool's
+    const uint64_t vao = StateId(mVaos, mesh.GetPool()? (const void*)mesh.GetPool() : (const void*)&mesh, 10);
+    const uint64_t textures = StateId(mTextureSets, mesh.GetTextureKey(), 10);
+    const uint64_t state = (program << 32) | (vao << 22) | (textures << 12) | std::min<uint64_t>(instance, 0xFFF);
+
+    const uint64_t key = mesh.IsTranslucent()? (1ull << 63) | ((~depth & 0xFFFFFF) << 39) | state :
+                                                (state << 24) | depth;
+    mEntries.push_back({key, (uint32_t)mPackets.size()});
+    mPackets.push_back({&shader, &mesh, instance, (uint32_t)lod, culled});
+  }
+
+  // sorts and draws everything added since Begin. plain model uniforms are set for programs that
+  // still declare them, block-based ones read the Object buffer
+  void Flush(){
+    RadixSort(mEntries, mScratch);
+
+    for(size_t p = 0; p < mPools.size(); p++){
+      mCommands[p].clear();
+      mDrawParams[p].clear();
+    }
+    mBatches.clear();
+
+    // ranges are collected in sorted order, so each pool's commands for a run are contiguous
+    size_t translucentStart = SIZE_MAX;
+    for(auto& entry: mEntries){
+      const Packet& packet = mPackets[entry.index];
+      if(translucentStart == SIZE_MAX && (entry.key >> 63)) translucentStart = mBatches.size();
+
+      GeometryPool* pool = packet.mesh->GetPool();
+      if(!pool){
+        mBatches.push_back({packet.shader, packet.mesh, nullptr, packet.instance, packet.lod, packet.culled, 0, 0});
+        continue;
+      }
+
+      const size_t p = PoolIndex(pool);
+      const size_t before = mCommands[p].size();
+      packet.mesh->AppendDraws(mCommands[p], mDrawParams[p], packet.lod, packet.culled? &mInstances[packet.instance].cull : nullptr);
+      if(mCommands[p].size() == before) continue;
+
+      Batch* last = mBatches.empty() || mBatches.size() == translucentStart? nullptr : &mBatches.back();
+      if(last && last->pool == pool && last->shader == packet.shader && last->instance == packet.instance &&
+         last->mesh->GetTextureKey() == packet.mesh->GetTextureKey())
+        last->count += mCommands[p].size() - before;
+      else mBatches.push_back({packet.shader, packet.mesh, pool, packet.instance, packet.lod, packet.culled, before, mCommands[p].size() - before});
+    }
+
+    for(size_t p = 0; p < mPools.size(); p++)
+      if(!mCommands[p].empty()) mPools[p]->Upload(mCommands[p], mDrawParams[p]);
+
+    Shader* shader = nullptr;
+    GeometryPool* bound = nullptr;
+    uint32_t instance = UINT32_MAX;
+    uint64_t textures = 0;
+    bool haveTextures = false;
+    for(size_t b = 0; b < mBatches.size(); b++){
+      const Batch& batch = mBatches[b];
+      if(b == translucentStart){
+        GLState::Get().SetEnabled(GL_BLEND, true);
+        GLState::Get().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GLState::Get().DepthMask(false);
+      }
+
+      if(batch.shader != shader){
+        shader = batch.shader;
+        shader->Use();
+        instance = UINT32_MAX;
+      }
+      if(batch.instance != instance){
+        instance = batch.instance;
+        mObject.Update({mInstances[instance].model});
+        shader->SetValue(UNIFORM_MODEL, mInstances[instance].model);
+      }
+      if(!haveTextures || batch.mesh->GetTextureKey() != textures){
+        BindTextures(batch.mesh->mTextures);
+        textures = batch.mesh->GetTextureKey();
+        haveTextures = true;
+      }
+
+      if(batch.pool){
+        if(batch.pool != bound){
+          if(bound) bound->EndDraws();
+          bound = batch.pool;
+          bound->BeginDraws();
+        }
+        bound->DrawRange(batch.first, batch.count);
+      }
+      else{
+        if(bound) bound->EndDraws();
+        bound = nullptr;
+        batch.mesh->Draw(batch.lod, batch.culled? &mInstances[batch.instance].cull : nullptr);
+      }
+    }
+    if(bound) bound->EndDraws();
+    if(translucentStart != SIZE_MAX){
+      GLState::Get().SetEnabled(GL_BLEND, false);
+      GLState::Get().DepthMask(true);
+    }
+    Clear();
+  }
+};
+
+class Model{
+private:
+  std::vector<Mesh> mModelMeshes;
+  std::string directory;
+
+  // one image a material references, embedded data points into the aiScene or the mapped mesh cache.
+  // an empty path is an unused slot of a packed texture
+  struct TextureSource{
+    std::string path;
+    const unsigned char* embedded = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t size = 0;
+  };
+
+  // texture decodes in flight while a model is loading, owned by the loading thread
+  struct PendingTexture{
+    std::string path;
+    std::vector<std::string> sources;
+    std::string key;
+    std::future<DecodedImage> image;
+    std::shared_ptr<TextureResource> resource;
+  };
+
+  struct TextureRef{
+    std::string type;
+    size_t slot;
+  };
+
+  // handed from the loading thread to the GL thread, drained by PumpUploads
+  struct UploadItem{
+    enum Kind{PLACEHOLDER, TEXTURE, MESH, DONE, FAILED};
+    Kind kind;
+
+    size_t slot = 0;
+    std::string path;
+    std::string key;
+    DecodedImage image;
+    std::shared_ptr<TextureResource> resource;
+
+    // view points into data or into the mapped cache file, cached meshes keep their tables in data
+    std::shared_ptr<MeshData> data;
+    MeshView view;
+    std::vector<TextureRef> textures;
+
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // references the loader took from the TextureCache, dropped on the GL thread with the item
+    std::vector<std::shared_ptr<TextureResource>> released;
+
+    size_t Bytes() const{
+      if(kind == TEXTURE) return image.Bytes();
+      if(kind == MESH) return view.Bytes();
+      return 0;
+    }
+  };
+
+  struct StreamedTexture{
+    std::string path;
+    std::shared_ptr<TextureResource> resource;
+  };
+
+  std::vector<PendingTexture> mPendingTextures;
+  std::unordered_map<std::string, size_t> mPendingLookup;
+  bool mParallelImport;
+  bool mAsync;
+  ModelSettings mSettings;
+  uint32_t mSettingsKey;
+
+  std::mutex mUploadMutex;
+  std::deque<UploadItem> mUploads;
+  std::vector<StreamedTexture> mStreamedTextures;
+  std::unique_ptr<Mesh> mPlaceholder;
+  size_t mUploadBudget;
+  bool mLoaded;
+  bool mFailed;
+
+  // the cache stays mapped until every mesh streamed out of it has been uploaded
+  MappedFile mCacheFile;
+  std::thread mLoader;
+  std::atomic<bool> mCancel;
+
+  void Configure(const std::string& path, const ModelSettings& settings){
+    mParallelImport = settings.parallelImport;
+    mUploadBudget = settings.uploadBudget;
+    mSettings = settings;
+    mSettingsKey = settings.CacheKey();
+    // BPTC is core, so drivers without S3TC still get compressed colour maps
+    if(mSettings.textureCompression == TextureCompression::BC1 && !HasGLExtension("GL_EXT_texture_compression_s3tc"))
+      mSettings.textureCompression = TextureCompression::BC7;
+
+    size_t slash = path.find_last_of('/');
+    directory = (slash == std::string::npos)? "." : path.substr(0, slash);
+  }
+
+  // runs on the loading thread (or inline for a blocking load), never touches GL
+  void Load(const std::string& path){
+    ScopedTimer timer("import", "load " + path);
+    auto source = std::make_shared<MappedFile>();
+    if(!source->Open(path, MADV_SEQUENTIAL)){
+      std::cerr<<"ERROR: opening model -> "<<path<<std::endl;
+      Fail();
+      return;
+    }
+    const uint64_t sourceSize = source->Size();
+    const uint64_t sourceHash = HashBytes(source->Data(), source->Size());
 
-public:
-  VAO(){glGenVertexArrays(1, &mId);}
-  ~VAO(){glDeleteVertexArrays(1, &mId);}
+    const std::string cachePath = path + "." + ImportProfileName(mSettings.importProfile) + ".meshcache";
+    bool cached;
+    {
+      ScopedTimer cacheTimer("import", "mesh cache " + cachePath);
+      cached = LoadCache(cachePath, sourceHash, sourceSize);
+    }
+    if(!cached){
+      // the importer owns the IO system and reads the already mapped model from it
+      MappedIOSystem* io = new MappedIOSystem();
+      io->Preload(path, std::move(source));
+      Assimp::Importer importer;
+      importer.SetIOHandler(io);
+      const aiScene* scene;
+      {
+        ScopedTimer assimpTimer("import", std::string("assimp ") + ImportProfileName(mSettings.importProfile) + " " + path);
+        scene = importer.ReadFile(path.c_str(), ImportFlags(mSettings.importProfile));
+      }
+      if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode){
+        std::cerr<<"ASSIMP::ERROR: "<<importer.GetErrorString()<<std::endl;
+        Fail();
+        return;
+      }
 
-  VAO(const VAO&) = delete;
-  VAO(VAO&& other) noexcept : mId(other.mId){other.mId = 0;}
-  VAO& operator=(VAO&& other) noexcept{
-    if(this != other){
-      glDeleteVertexArrays(1, &mId);
-      mId = other.mId;
-      other.mId = 0;
+      std::vector<std::shared_ptr<MeshData>> meshData;
+      std::vector<std::vector<TextureRef>> textureRefs;
+      glm::vec3 boundsMin;
+      glm::vec3 boundsMax;
+      {
+        ScopedTimer processTimer("import", "process meshes " + path);
+        ProcessScene(scene, meshData, textureRefs, boundsMin, boundsMax);
+      }
+      SaveCache(cachePath, sourceHash, sourceSize, scene, meshData, textureRefs, boundsMin, boundsMax);
     }
-    return *this;
+
+    UploadItem done;
+    done.kind = UploadItem::DONE;
+    done.released = ClearPendingTextures();
+    PushUpload(std::move(done));
   }
 
-  void Bind(){glBindVertexArrays(mId);}
-  void Unbind(){glBindVertexArrays(0);}
+  // a blocking load is fatal as before, an async one runs on the loader thread where exiting would
+  // tear the process down under the render loop, so the GL thread is told instead
+  void Fail(){
+    if(!mAsync) exit(1);
+    UploadItem failed;
+    failed.kind = UploadItem::FAILED;
+    failed.released = ClearPendingTextures();
+    PushUpload(std::move(failed));
+  }
 
-  void SetAttrib(int loc, int nr, size_t stride, size_t offset){
-    glEnableVertexAttribArray(loc);
-    glVertexAttribPointer(loc, nr, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+  void PushUpload(UploadItem&& item){
+    std::lock_guard<std::mutex> lock(mUploadMutex);
+    mUploads.push_back(std::move(item));
   }
-};
 
-struct Vertex{
-  glm::vec3 position;
-  glm::vec3 normal;
-  glm::vec2 texcoord;
-};
+  void PushPlaceholder(const glm::vec3& boundsMin, const glm::vec3& boundsMax){
+    if(!mAsync) return;
+    UploadItem item;
+    item.kind = UploadItem::PLACEHOLDER;
+    item.boundsMin = boundsMin;
+    item.boundsMax = boundsMax;
+    PushUpload(std::move(item));
+  }
 
-struct Texture{
-  std::string type;
-  std::string path;
-  unsigned int id;
-};
+  // hands each mesh to the GL thread as soon as the textures it references are decoded
+  void StreamMeshes(std::vector<UploadItem>& meshes){
+    std::vector<bool> sent(mPendingTextures.size(), false);
+    for(auto& mesh: meshes){
+      if(mCancel) return;
 
-class Mesh{
-private:  
-  VBO mVbo;
-  EBO mEbo;
-  VAO mVao;
+      for(auto& ref: mesh.textures){
+        if(sent[ref.slot]) continue;
+        sent[ref.slot] = true;
 
-  void SetupMesh(){
-    mVao.Bind();
-    mVbo.Bind();
-    mVbo.AllocateAndFillMem(mVertices.size() * sizeof(Vertex), mVertices.data(), GL_STATIC_DRAW);
-    mEbo.Bind();
-    mEbo.AllocateAndFillMem(mIndices.size() * sizeof(unsigned int), mIndices.data(), GL_STATIC_DRAW);
-    mVao.SetAttrib(0, 3, sizeof(Vertex), offsetof(Vertex, position));
-    mVao.SetAttrib(1, 3, sizeof(Vertex), offsetof(Vertex, normal));
-    mVao.SetAttrib(2, 2, sizeof(Vertex), offsetof(Vertex, texcoord));
+        PendingTexture& pending = mPendingTextures[ref.slot];
+        UploadItem item;
+        item.kind = UploadItem::TEXTURE;
+        item.slot = ref.slot;
+        item.path = pending.path;
+        item.key = pending.key;
+        item.resource = pending.resource;
+        if(!item.resource) item.image = pending.image.get();
+        PushUpload(std::move(item));
+      }
 
-    mVao.Unbind();
+      PushUpload(std::move(mesh));
+    }
   }
 
-public:
-  std::vector<Vertex> mVertices;
-  std::vector<unsigned int> mIndices;
-  std::vector<Texture> mTextures;
-  
-  Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<Texture>& textures){
-    mVertices = vertices;
-    mIndices = indices;
-    mTextures = textures;
-    SetupMesh();
-  }
+  // GL thread: uploads queued items until the byte budget for this call is spent
+  void PumpUploads(size_t budget){
+    size_t spent = 0;
+    for(;;){
+      UploadItem item;
+      {
+        std::lock_guard<std::mutex> lock(mUploadMutex);
+        if(mUploads.empty()) return;
+        const size_t bytes = mUploads.front().Bytes();
+        // always make progress, even when a single item is larger than the whole budget
+        if(spent > 0 && spent + bytes > budget) return;
+        spent += bytes;
+        item = std::move(mUploads.front());
+        mUploads.pop_front();
+      }
 
-  ~Mesh()=default;
+      switch(item.kind){
+        case UploadItem::PLACEHOLDER:
+          mPlaceholder = BuildPlaceholder(item.boundsMin, item.boundsMax);
+          break;
 
-  void Draw(Shader& shader){
-    shader.Use();
+        case UploadItem::TEXTURE:
+          // another model may have uploaded the same image while this one was decoding
+          if(!item.resource) item.resource = TextureCache::Get().Find(item.key);
+          if(!item.resource){
+            ScopedTimer timer("upload", "texture " + item.path);
+            int array, layer;
+            if(mSettings.textureArrays && TextureArrayPool::Get().Insert(item.image, array, layer))
+              item.resource = TextureCache::Get().Insert(item.key, array, layer);
+            else if(mSettings.streamTextures && !item.image.levels.empty()){
+              const size_t base = StreamingBaseLevel(item.image, mSettings.streamingResidentSize);
+              item.resource = TextureCache::Get().Insert(item.key, UploadTexture(item.image, base));
+              TextureStreamer::Get().Add(item.resource->GetId(), std::make_shared<DecodedImage>(std::move(item.image)), base);
+            }
+            else item.resource = TextureCache::Get().Insert(item.key, UploadTexture(item.image));
+          }
+          if(mStreamedTextures.size() <= item.slot) mStreamedTextures.resize(item.slot + 1);
+          mStreamedTextures[item.slot] = {item.path, item.resource};
+          break;
 
-    unsigned int diffuseNr = 1;
-    unsigned int specularNr = 1;
-    for(unsigned int i = 0; i < mTextures.size(); i++){
-      glActiveTexture(GL_TEXTURE0 + i);
+        case UploadItem::MESH:{
+          ScopedTimer timer("upload", "mesh " + std::to_string(mModelMeshes.size()));
+          mModelMeshes.emplace_back(item.view, ResolveTextures(item.textures), mSettings.sharedGeometry? &GeometryPool::Get(item.view.format) : nullptr);
+          mModelMeshes.back().SetMaterial(MaterialTable::Get().Add(BuildMaterial(item.view.material, mModelMeshes.back().mTextures)),
+                                          item.view.material.baseColor.a < 1.0f);
+          mPlaceholder.reset();
+          break;
+        }
 
-      std::string number;
-      std::string name = mTextures[i].type;
-      if(name == "texture_diffuse") number = std::to_string(diffuseNr++);
-      else if(name == "texture_specular") number = std::to_string(specularNr++);
-      
-      shader.SetValue("material."+name+number, i);
-      glBindTexture(GL_TEXTURE_2D, mTextures[i].id);
-    }
-    glActiveTexture(GL_TEXTURE0);
+        case UploadItem::DONE:
+          if(mLoader.joinable()) mLoader.join();
+          mCacheFile.Close();
+          mStreamedTextures.clear();
+          mPlaceholder.reset();
+          mLoaded = true;
+          break;
 
-    mVao.Bind();
-    glDrawElements(GL_TRIANGLES, mIndices.size(), GL_UNSIGNED_INT, 0);
-    mVao.Unbind();
+        // the placeholder, if any, stays up in place of the model
+        case UploadItem::FAILED:
+          if(mLoader.joinable()) mLoader.join();
+          mCacheFile.Close();
+          mStreamedTextures.clear();
+          mFailed = true;
+          break;
+      }
+    }
   }
-};
 
-class Model{
-private:
-  std::vector<Mesh> mModelMeshes;
-  std::string directory;
+  static std::unique_ptr<Mesh> BuildPlaceholder(const glm::vec3& boundsMin, const glm::vec3& boundsMax){
+    const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    std::vector<Vertex> vertices;
+    for(int i = 0; i < 8; i++){
+      Vertex v;
+      v.position = {(i & 1)? boundsMax.x : boundsMin.x, (i & 2)? boundsMax.y : boundsMin.y, (i & 4)? boundsMax.z : boundsMin.z};
+      v.normal = (v.position == center)? glm::vec3(0.0f, 0.0f, 1.0f) : glm::normalize(v.position - center);
+      v.texcoord = {0.0f, 0.0f};
+      vertices.push_back(v);
+    }
+
+    std::vector<unsigned int> indices = {
+      0,2,1, 1,2,3,  4,5,6, 5,7,6,
+      0,1,4, 1,5,4,  2,6,3, 3,6,7,
+      0,4,2, 2,4,6,  1,3,5, 3,7,5
+    };
+    return std::make_unique<Mesh>(std::move(vertices), std::move(indices), std::vector<Texture>());
+  }
 
-  void ProcessNode(aiNode* node, const aiScene* scene){
+  void ProcessNode(aiNode* node, const aiScene* scene, std::vector<const aiMesh*>& jobs){
     for(unsigned int i = 0; i < node->mNumMeshes; i++){
-      aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-      mModelMeshes.push_back(ProcessMesh(mesh, scene));
+      jobs.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
 
     for(unsigned int i = 0; i < node->mNumChildren; i++){
-      ProcessNode(node->mChildren[i], scene);
+      ProcessNode(node->mChildren[i], scene, jobs);
     }
   }
 
-  Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene){
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+  void ProcessScene(const aiScene* scene, std::vector<std::shared_ptr<MeshData>>& meshData, std::vector<std::vector<TextureRef>>& textureRefs, glm::vec3& boundsMin, glm::vec3& boundsMax){
+    std::vector<const aiMesh*> jobs;
+    ProcessNode(scene->mRootNode, scene, jobs);
+
+    boundsMin = glm::vec3(jobs.empty()? 0.0f : FLT_MAX);
+    boundsMax = glm::vec3(jobs.empty()? 0.0f : -FLT_MAX);
+    for(const aiMesh* mesh: jobs){
+      for(unsigned int i = 0; i < mesh->mNumVertices; i++){
+        const glm::vec3 p(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+      }
+    }
+    PushPlaceholder(boundsMin, boundsMax);
+
+    // queue every texture decode first so it overlaps with the mesh conversion below
+    textureRefs.resize(jobs.size());
+    std::vector<MaterialFactors> factors(jobs.size());
+    for(size_t i = 0; i < jobs.size(); i++){
+      textureRefs[i] = ProcessMaterial(jobs[i], scene);
+      factors[i] = ReadMaterialFactors(jobs[i], scene);
+    }
+
+    meshData.resize(jobs.size());
+    if(mParallelImport && jobs.size() > 1){
+      std::vector<std::future<void>> pending;
+      pending.reserve(jobs.size());
+      for(size_t i = 0; i < jobs.size(); i++)
+        pending.push_back(ThreadPool::Get().Submit([this, &meshData, &jobs, i]{meshData[i] = std::make_shared<MeshData>(ProcessMesh(jobs[i], mSettings));}));
+      for(auto& job: pending)
+        job.get();
+    }
+    else{
+      for(size_t i = 0; i < jobs.size(); i++)
+        meshData[i] = std::make_shared<MeshData>(ProcessMesh(jobs[i], mSettings));
+    }
+
+    for(size_t i = 0; i < jobs.size(); i++)
+      meshData[i]->material = factors[i];
+    if(mSettings.optimizeMeshes) ReportOptimization(meshData);
+
+    std::vector<UploadItem> meshes(jobs.size());
+    for(size_t i = 0; i < jobs.size(); i++){
+      meshes[i].kind = UploadItem::MESH;
+      meshes[i].data = meshData[i];
+      meshes[i].view = MeshView::From(*meshData[i]);
+      meshes[i].textures = textureRefs[i];
+    }
+    StreamMeshes(meshes);
+  }
+
+  static MeshData ProcessMesh(const aiMesh* mesh, const ModelSettings& settings){
+    MeshData data;
+    data.vertices.reserve(mesh->mNumVertices);
+    data.indices.reserve((size_t)mesh->mNumFaces * 3);
 
     for(unsigned int i = 0; i < mesh->mNumVertices; i++){
       Vertex v;
@@ -339,253 +4987,535 @@ private:
       }
 
       if(mesh->mTextureCoords[0]){
-        v.texcoord.x = mTextureCoords[0][i].x;
-        v.texcoord.y = mTextureCoords[0][i].y;
+        v.texcoord.x = mesh->mTextureCoords[0][i].x;
+        v.texcoord.y = mesh->mTextureCoords[0][i].y;
       }
       else{
         v.texcoord = {0.0f,0.0f};
       }
 
-      vertices.push_back(v);
+      data.vertices.push_back(v);
     }
 
     for(unsigned int i = 0; i < mesh->mNumFaces; i++){
-      aiFace face = mesh->mFaces[i];
-      for(unsigned int j = 0; j < face.mNumIndices; i++){
-        indices.push_back(face.mIndices[i]);
+      const aiFace& face = mesh->mFaces[i];
+      for(unsigned int j = 0; j < face.mNumIndices; j++){
+        data.indices.push_back(face.mIndices[j]);
       }
     }
-    
+
+    if(settings.optimizeMeshes || settings.lodLevels > 1) WeldVertices(data.vertices, data.indices);
+    ComputeBounds(data.vertices.data(), data.vertices.size(), data.boundsMin, data.boundsMax);
+    if(settings.lodLevels > 1) data.BuildLods(settings.lodLevels, settings.lodTargetError);
+    if(settings.optimizeMeshes) data.Optimize(settings.optimizeOverdraw);
+    if(settings.meshlets) data.BuildMeshlets();
+    if(settings.vertexFormat == VertexFormat::Packed) data.Pack();
+    if(settings.optimizeMeshes) data.CompactIndices();
+
+    return data;
+  }
+
+  static void ReportOptimization(const std::vector<std::shared_ptr<MeshData>>& meshData){
+    double triangles = 0.0;
+    double vertices = 0.0;
+    VertexCacheStats before;
+    VertexCacheStats after;
+    for(auto& data: meshData){
+      const double t = data->lods.empty()? data->IndexCount() / 3 : data->lods[0].indexCount / 3;
+      const double v = data->VertexCount();
+      before.acmr += data->cacheBefore.acmr * t;
+      after.acmr += data->cacheAfter.acmr * t;
+      before.atvr += data->cacheBefore.atvr * v;
+      after.atvr += data->cacheAfter.atvr * v;
+      triangles += t;
+      vertices += v;
+    }
+    if(triangles == 0.0) return;
+
+    std::cout<<"Optimized "<<meshData.size()<<" meshes: ACMR "<<before.acmr / triangles<<" -> "<<after.acmr / triangles
+             <<", ATVR "<<before.atvr / vertices<<" -> "<<after.atvr / vertices<<std::endl;
+  }
+
+  // metallic-roughness factors where the format has them, the classic diffuse colour and opacity otherwise
+  static MaterialFactors ReadMaterialFactors(const aiMesh* mesh, const aiScene* scene){
+    MaterialFactors factors;
+    if(mesh->mMaterialIndex >= scene->mNumMaterials) return factors;
+    const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+
+    aiColor4D baseColor;
+    aiColor3D diffuse;
+    float opacity;
+    if(material->Get(AI_MATKEY_BASE_COLOR, baseColor) == AI_SUCCESS)
+      factors.baseColor = glm::vec4(baseColor.r, baseColor.g, baseColor.b, baseColor.a);
+    else if(material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == AI_SUCCESS)
+      factors.baseColor = glm::vec4(diffuse.r, diffuse.g, diffuse.b, 1.0f);
+    if(material->Get(AI_MATKEY_OPACITY, opacity) == AI_SUCCESS) factors.baseColor.a *= opacity;
+    material->Get(AI_MATKEY_ROUGHNESS_FACTOR, factors.roughness);
+    material->Get(AI_MATKEY_METALLIC_FACTOR, factors.metallic);
+    return factors;
+  }
+
+  std::vector<TextureRef> ProcessMaterial(const aiMesh* mesh, const aiScene* scene){
+    std::vector<TextureRef> textures;
+
     // check if that mesh has an assigned material
-    if(mesh->mMaterialIndex >= 0){
+    if(mesh->mMaterialIndex < scene->mNumMaterials){
       aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-      std::vector<Texture> diffuseMaps = LoadMaterialTexture(material, aiTextureType_DIFFUSE, "texture_diffuse", scene);
-      std::vector<Texture> specularMaps = LoadMaterialTexture(material, aiTextureType_SPECULAR, "texture_specular", scene);
-      std::vector<Texture> normalMaps = LoadMaterialTexture(material, aiTextureType_HEIGHT, "texture_normal", scene);
-      textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-      textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-      textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+      LoadMaterialTexture(material, aiTextureType_DIFFUSE, "texture_diffuse", scene, textures);
+      LoadMaterialTexture(material, aiTextureType_SPECULAR, "texture_specular", scene, textures);
+      LoadMaterialTexture(material, aiTextureType_HEIGHT, "texture_normal", scene, textures);
+      LoadOrmTexture(material, scene, textures);
     }
 
-    return Mesh(vertices, indices, textures);
+    return textures;
   }
   
-  std::vector<Texture> LoadMaterialTexture(aiMaterial* mat, aiTextureType type, const std::string& typeName, const aiScene* scene){
-    std::vector<Texture> textures;
-    
-    for(unsigned int i = 0; i < mat->GetTextureCount(type); i++){
-      aiString str;
-      mat->GetTexture(type, i, &str);
+  // resolves "*N" references to the scene's embedded textures
+  static TextureSource GetMaterialTexture(aiMaterial* mat, aiTextureType type, unsigned int index, const aiScene* scene){
+    aiString str;
+    mat->GetTexture(type, index, &str);
 
-      Texture texture;
+    TextureSource source;
+    source.path = str.C_Str();
+    if(source.path.empty() || source.path[0] != '*') return source;
 
-      if(str.C_Str()[0] == "*"){
-        int index = atoi(str.C_Str() + 1);
-        const aiTexture* tex = scene->mTextures[index];
-        texture.id = (tex->mHeight == 0)? TextureFromMemoryCompressed(tex->pcData, tex->mWidth) : TextureFromMemory(tex->pcData, tex->mWidth, tex->mHeight);
-      }
-      else{
-        std::string filename = std::string(str.C_Str());
-        filename = directory + "/" + filename;
-        texture.id = TextureFromFile(filename);
-      }
+    unsigned int embedded = atoi(source.path.c_str() + 1);
+    if(embedded >= scene->mNumTextures) return source;
+    const aiTexture* tex = scene->mTextures[embedded];
+    source.embedded = reinterpret_cast<const unsigned char*>(tex->pcData);
+    source.width = tex->mWidth;
+    source.height = tex->mHeight;
+    source.size = (tex->mHeight == 0)? tex->mWidth : (uint64_t)tex->mWidth * tex->mHeight * sizeof(aiTexel);
+    return source;
+  }
 
-      texture.type = typeName;
-      texture.path = str.C_str();
-      textures.push_back(texture);
-    }
-    return textures;
+  void LoadMaterialTexture(aiMaterial* mat, aiTextureType type, const std::string& typeName, const aiScene* scene, std::vector<TextureRef>& textures){
+    for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+      textures.push_back({typeName, QueueTexture(GetMaterialTexture(mat, type, i, scene), typeName)});
   }
 
-  unsigned int TextureFromMemoryCompressed(const aiTexel* pixels, int mwidth){
-    unsigned int texid;
-    glGenTextures(1, &texid);
-    glBindTexture(GL_TEXTURE_2D, texid);
-    
-    int width;
-    int height;
-    int nrChannels;
-    unsigned char* data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(pixels), mwidth, &width, &height, &nrChannels, 0);
-    
-    if(data){
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-      glGenerateMipmap(GL_TEXTURE_2D);
+  // occlusion, roughness and metallic maps become one "texture_orm", sampled once by the shader
+  void LoadOrmTexture(aiMaterial* mat, const aiScene* scene, std::vector<TextureRef>& textures){
+    const aiTextureType types[3] = {aiTextureType_AMBIENT_OCCLUSION, aiTextureType_DIFFUSE_ROUGHNESS, aiTextureType_METALNESS};
+    TextureSource sources[3];
+    bool any = false;
+    for(int m = 0; m < 3; m++){
+      if(mat->GetTextureCount(types[m]) == 0) continue;
+      sources[m] = GetMaterialTexture(mat, types[m], 0, scene);
+      any = true;
     }
+    if(any) textures.push_back({"texture_orm", QueueOrmTexture(sources)});
+  }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    return texid;
+  std::string SourceKey(const TextureSource& source) const{
+    if(source.path.empty()) return "none";
+    if(source.path[0] != '*') return TextureCache::KeyForFile(directory + "/" + source.path);
+    if(source.embedded) return TextureCache::KeyForMemory(source.embedded, source.size, source.width, source.height);
+    return "missing:" + source.path;
   }
 
-  unsigned int TextureFromMemory(const aiTexel* pixels, int mwidth, int mheight){
-    unsigned int texid;
-    glGenTextures(1, &texid);
-    glBindTexture(GL_TEXTURE_2D, texid);
+  // the bytes of one source while a worker bakes it: a read-only mapping for files, the embedded data
+  // otherwise. hashing and decoding both read from it, so a file is only mapped once
+  struct SourceView{
+    MappedFile file;
+    const unsigned char* data = nullptr;
+    uint64_t size = 0;
+  };
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, mwidth, mheight, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-     
-    return texid;
+  static SourceView OpenSource(const TextureSource& source, const std::string& directory){
+    SourceView view;
+    if(!source.path.empty() && source.path[0] != '*'){
+      if(view.file.Open(directory + "/" + source.path, MADV_SEQUENTIAL)){
+        view.data = view.file.Data();
+        view.size = view.file.Size();
+      }
+    }
+    else if(source.embedded){
+      view.data = source.embedded;
+      view.size = source.size;
+    }
+    return view;
   }
 
-  unsigned int TextureFromFile(const std::string& path){
-    unsigned int texid;
-    glGenTextures(1, &texid);
-    glBindTexture(GL_TEXTURE_2D, texid);
+  static DecodedImage DecodeSource(const TextureSource& source, const SourceView& view){
+    if(!view.data) return DecodedImage();
+    if(source.embedded && source.height != 0) return CopyImagePixels(source.embedded, source.width, source.height);
+    return DecodeImageMemory(view.data, view.size, source.path);
+  }
 
-    int width;
-    int height;
-    int nrChannels;
-    
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
-    if(data){
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-      glGenerateMipmap(GL_TEXTURE_2D); 
+  size_t AddPending(PendingTexture pending, const std::function<DecodedImage()>& decode){
+    if(!pending.resource)
+      pending.image = mParallelImport? ThreadPool::Get().Submit(decode) : std::async(std::launch::deferred, decode);
+    mPendingLookup[pending.key] = mPendingTextures.size();
+    mPendingTextures.push_back(std::move(pending));
+    return mPendingTextures.size() - 1;
+  }
+
+  // start decoding on the worker pool unless the image is already resident in the TextureCache.
+  // embedded data must stay valid until StreamMeshes has collected the result
+  size_t QueueTexture(const TextureSource& source, const std::string& type){
+    std::string key = SourceKey(source);
+
+    // one source image is baked differently for different map types
+    const bool isFile = !source.path.empty() && source.path[0] != '*';
+    const bool bake = isFile || source.embedded;
+    const TextureUsage usage = UsageForType(type);
+    std::string suffix;
+    if(bake){
+      suffix = TextureCacheSuffix(usage, mSettings.Bake(usage));
+      key += "|" + suffix;
+      if(mSettings.textureArrays) key += "|array";
     }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    stbi_image_free(data);
+    auto it = mPendingLookup.find(key);
+    if(it != mPendingLookup.end()) return it->second;
+
+    PendingTexture pending;
+    pending.path = source.path;
+    pending.sources = {source.path};
+    pending.key = key;
+    pending.resource = TextureCache::Get().Find(key);
+    if(pending.resource) return AddPending(std::move(pending), nullptr);
 
-    return texid;
+    if(!bake) return AddPending(std::move(pending), []{return DecodedImage();});
+
+    // embedded images are cached beside the model under their content hash
+    const std::string cachePath = (isFile? directory + "/" + source.path : directory + "/embedded_" + key.substr(4, 16)) + "." + suffix + ".ktc";
+    const std::string dir = directory;
+    const BakeOptions options = mSettings.Bake(usage);
+    auto decode = [source, dir, cachePath, usage, options]{
+      ScopedTimer timer("texture", "decode " + source.path);
+      const SourceView view = OpenSource(source, dir);
+      const uint64_t sourceHash = view.data? HashBytes(view.data, view.size) : 0;
+      return BakeTexture(cachePath, sourceHash, [&]{return DecodeSource(source, view);}, usage, options);
+    };
+    return AddPending(std::move(pending), decode);
   }
 
-public:
-  Model() {}
+  // sources are occlusion, roughness, metallic, with empty paths for the ones the material lacks.
+  // the packed result is cached beside the model under the hash of the three source keys
+  size_t QueueOrmTexture(const TextureSource sources[3]){
+    std::string sourceKeys;
+    for(int m = 0; m < 3; m++) sourceKeys += SourceKey(sources[m]) + ";";
+    const BakeOptions options = mSettings.Bake(TextureUsage::Orm);
+    const std::string suffix = TextureCacheSuffix(TextureUsage::Orm, options);
+    const std::string key = "orm:" + sourceKeys + "|" + suffix + (mSettings.textureArrays? "|array" : "");
 
-  Model(const std::string& path){
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path.c_str(), aiProcess_Triangulate | aiProcess_GenNormals);
-    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode){
-      std::cerr<<"ASSIMP::ERROR: "<<importer.GetErrorString()<<std::endl;
-      exit(1);
-    }
-    
-    ProcessNode(scene->mRootNode, scene);
+    auto it = mPendingLookup.find(key);
+    if(it != mPendingLookup.end()) return it->second;
+
+    PendingTexture pending;
+    pending.path = "orm:" + sources[0].path + ";" + sources[1].path + ";" + sources[2].path;
+    pending.sources = {sources[0].path, sources[1].path, sources[2].path};
+    pending.key = key;
+    pending.resource = TextureCache::Get().Find(key);
+    if(pending.resource) return AddPending(std::move(pending), nullptr);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/orm_%016llx.", (unsigned long long)HashBytes(sourceKeys.data(), sourceKeys.size()));
+    const std::string cachePath = directory + name + suffix + ".ktc";
+
+    const std::vector<TextureSource> maps(sources, sources + 3);
+    const bool shared = !sources[1].path.empty() && sources[1].path == sources[2].path;
+    const std::string dir = directory;
+
+    auto decode = [maps, shared, dir, cachePath, options]{
+      ScopedTimer timer("texture", "decode " + cachePath);
+      SourceView views[3];
+      uint64_t hashes[3];
+      for(int m = 0; m < 3; m++){
+        // a metallicRoughness image shared by two slots is mapped once
+        if(m == 2 && shared){
+          views[m].data = views[1].data;
+          views[m].size = views[1].size;
+        }
+        else views[m] = OpenSource(maps[m], dir);
+        hashes[m] = views[m].data? HashBytes(views[m].data, views[m].size) : 0;
+      }
+      auto pack = [&]{
+        DecodedImage images[3];
+        for(int m = 0; m < 3; m++) images[m] = DecodeSource(maps[m], views[m]);
+        return PackOrm(images, shared);
+      };
+      return BakeTexture(cachePath, HashBytes(hashes, sizeof(hashes)), pack, TextureUsage::Orm, options);
+    };
+    return AddPending(std::move(pending), decode);
   }
 
-  ~Model()=default;
+  // factors plus the array placement of the first map of each kind
+  static MaterialData BuildMaterial(const MaterialFactors& factors, const std::vector<Texture>& textures){
+    MaterialData material = {};
+    material.baseColor = factors.baseColor;
+    material.roughness = factors.roughness;
+    material.metallic = factors.metallic;
+    material.arrays = glm::ivec4(-1);
+    material.layers = glm::ivec4(-1);
+    const char* kinds[4] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_orm"};
+    for(int k = 0; k < 4; k++)
+      for(auto& texture: textures)
+        if(texture.type == kinds[k] && texture.resource->GetArray() >= 0){
+          material.arrays[k] = texture.resource->GetArray();
+          material.layers[k] = texture.resource->GetLayer();
+          break;
+        }
+    return material;
+  }
 
-  void Draw(Shader& shader){
-    shader.Use();
-    for(auto& mesh: mModelMeshes)
-      mesh.Draw(shader);
+  std::vector<Texture> ResolveTextures(const std::vector<TextureRef>& refs) const{
+    std::vector<Texture> textures;
+    for(auto& ref: refs){
+      Texture texture;
+      texture.type = ref.type;
+      texture.path = mStreamedTextures[ref.slot].path;
+      texture.resource = mStreamedTextures[ref.slot].resource;
+      texture.id = texture.resource->GetId();
+      textures.push_back(texture);
+    }
+    return textures;
   }
 
-  // Add custom binary format for model loading/saving
-};
+  // cached resources found for pending textures may be the last reference once their owner is gone,
+  // and releasing one deletes GL objects, so they are returned for the GL thread to drop
+  std::vector<std::shared_ptr<TextureResource>> ClearPendingTextures(){
+    std::vector<std::shared_ptr<TextureResource>> resources;
+    // decodes still reference the scene or the mapped cache, let a cancelled load finish them first
+    for(auto& pending: mPendingTextures){
+      if(pending.image.valid()) pending.image.wait();
+      if(pending.resource) resources.push_back(std::move(pending.resource));
+    }
+    mPendingTextures.clear();
+    mPendingLookup.clear();
+    return resources;
+  }
 
-class Camera{
-private:
-  glm::vec3 mPosition;
-  glm::vec3 mFront;
-  glm::vec3 mUp;
+  // binary layout:
+  //   MeshCacheHeader
+  //   per mesh: vertexCount, indexCount, textureCount, vertex format, index type, lodCount, meshletCount (uint32),
+  //             bounds (6 floats), MaterialFactors, lodCount MeshLod records, meshletCount Meshlet records
+  //             per texture: type, source count, per source: path, embedded width/height/size + bytes
+  //             vertex array (16-byte aligned), index array (16-byte aligned)
+  void SaveCache(const std::string& cachePath, uint64_t sourceHash, uint64_t sourceSize, const aiScene* scene,
+                 const std::vector<std::shared_ptr<MeshData>>& meshData, const std::vector<std::vector<TextureRef>>& textureRefs,
+                 const glm::vec3& boundsMin, const glm::vec3& boundsMax){
+    BinaryWriter writer;
 
-  float mYaw;
-  float mPitch;
-  float mFov;
+    MeshCacheHeader header = {};
+    memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.meshCount = meshData.size();
+    header.settingsKey = mSettingsKey;
+    memcpy(header.boundsMin, &boundsMin[0], sizeof(header.boundsMin));
+    memcpy(header.boundsMax, &boundsMax[0], sizeof(header.boundsMax));
+    writer.Write(header);
 
-  float mSpeed;
-  float mSensitivity;
+    for(size_t m = 0; m < meshData.size(); m++){
+      const MeshData& mesh = *meshData[m];
+      writer.Write<uint32_t>(mesh.VertexCount());
+      writer.Write<uint32_t>(mesh.IndexCount());
+      writer.Write<uint32_t>(textureRefs[m].size());
+      writer.Write<uint32_t>((uint32_t)mesh.format);
+      writer.Write<uint32_t>(mesh.IndexType());
+      writer.Write<uint32_t>(mesh.lods.size());
+      writer.Write<uint32_t>(mesh.meshlets.size());
+      writer.Write(mesh.boundsMin);
+      writer.Write(mesh.boundsMax);
+      writer.Write(mesh.material);
+      writer.Write(mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+      writer.Write(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
 
-  float mLastX;
-  float mLastY;
+      for(auto& ref: textureRefs[m]){
+        const std::vector<std::string>& sources = mPendingTextures[ref.slot].sources;
+        writer.WriteString(ref.type);
+        writer.Write<uint32_t>(sources.size());
+        for(auto& path: sources){
+          writer.WriteString(path);
 
-  bool mFirstMouse;
-  
-  glm::mat4 mViewMatrix;
-  glm::mat4 mProjectionMatrix;
-  
-  void UpdateMovement(float dt){
-    if(IsKeyPressed(GLFW_KEY_W)) mPosition += mSpeed * dt * mFront;
-    if(IsKeyPressed(GLFW_KEY_S)) mPosition -= mSpeed * dt * mFront;
-    if(IsKeyPressed(GLFW_KEY_A)) mPosition -= mSpeed * dt * glm::normalize(glm::cross(mFront, mUp));
-    if(IsKeyPressed(GLFW_KEY_D)) mPosition += mSpeed * dt * glm::normalize(glm::cross(mFront, mUp));
-    if(IsKeyPressed(GLFW_KEY_LEFT_SHIFT)) mSpeed = 10.0f;
-    else mSpeed = 6.0f;
+          const aiTexture* tex = nullptr;
+          if(!path.empty() && path[0] == '*'){
+            unsigned int index = atoi(path.c_str() + 1);
+            if(index < scene->mNumTextures) tex = scene->mTextures[index];
+          }
+
+          uint32_t width = tex? tex->mWidth : 0;
+          uint32_t height = tex? tex->mHeight : 0;
+          uint64_t size = !tex? 0 : (height == 0)? width : (uint64_t)width * height * sizeof(aiTexel);
+          writer.Write(width);
+          writer.Write(height);
+          writer.Write(size);
+          if(size) writer.Write(tex->pcData, size);
+        }
+      }
+
+      writer.Align(16);
+      writer.Write(mesh.VertexData(), mesh.VertexCount() * VertexStride(mesh.format));
+      writer.Align(16);
+      writer.Write(mesh.IndexData(), mesh.IndexCount() * IndexStride(mesh.IndexType()));
+    }
+
+    if(!writer.SaveToFile(cachePath))
+      std::cerr<<"WARNING: could not write mesh cache -> "<<cachePath<<std::endl;
   }
 
-public:
-  Camera(float speed, float sensitivity): mSpeed(speed), mSensitivity(sensitivity){
-    mPosition = {0.0f, 0.0f, 3.0f};
-    mFront = {0.0f, 0.0f, -1.0f};
-    mUp = {0.0f, 1.0f, 0.0f};
+  bool LoadCache(const std::string& cachePath, uint64_t sourceHash, uint64_t sourceSize){
+    MappedFile file;
+    if(!file.Open(cachePath)) return false;
 
-    mYaw = -90.0f;
-    mPitch = 0.0f;
-    mFov = 45.0f;
+    BinaryReader reader(file.Data(), file.Size());
+    MeshCacheHeader header;
+    if(!reader.Read(header)) return false;
+    if(memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 || header.version != MESH_CACHE_VERSION) return false;
+    if(header.sourceHash != sourceHash || header.sourceSize != sourceSize || header.settingsKey != mSettingsKey) return false;
 
-    mLastX = 0.0f;
-    mLastY = 0.0f;
+    // validate the whole file before queueing any work
+    struct CachedTexture{
+      std::string type;
+      std::vector<TextureSource> sources;
+    };
+    // LOD and meshlet tables are copied out of the file into tables, which the upload item keeps alive
+    struct CachedMesh{
+      MeshView view;
+      std::shared_ptr<MeshData> tables = std::make_shared<MeshData>();
+      std::vector<CachedTexture> textures;
+    };
+    std::vector<CachedMesh> cached(header.meshCount);
 
-    mFirstMouse = true;
-    
-    mViewMatrix = glm::mat4(1.0f);
-    mProjectionMatrix = glm::mat4(1.0f);
-  }
+    for(auto& mesh: cached){
+      uint32_t vertexCount;
+      uint32_t indexCount;
+      uint32_t textureCount;
+      uint32_t format;
+      uint32_t indexType;
+      uint32_t lodCount;
+      uint32_t meshletCount;
+      if(!reader.Read(vertexCount) || !reader.Read(indexCount) || !reader.Read(textureCount) || !reader.Read(format) || !reader.Read(indexType)) return false;
+      if(!reader.Read(lodCount) || !reader.Read(meshletCount)) return false;
+      if(format > (uint32_t)VertexFormat::Packed) return false;
+      if(indexType != GL_UNSIGNED_INT && indexType != GL_UNSIGNED_SHORT) return false;
+      if(!reader.Read(mesh.view.boundsMin) || !reader.Read(mesh.view.boundsMax) || !reader.Read(mesh.view.material)) return false;
+      const unsigned char* lods = reader.Skip((size_t)lodCount * sizeof(MeshLod));
+      if(!lods) return false;
+      std::vector<MeshLod>& lodTable = mesh.tables->lods;
+      lodTable.resize(lodCount);
+      memcpy(lodTable.data(), lods, lodTable.size() * sizeof(MeshLod));
+      for(auto& lod: lodTable)
+        if((uint64_t)lod.indexOffset + lod.indexCount > indexCount) return false;
+      mesh.view.lods = lodTable.data();
+      mesh.view.lodCount = lodTable.size();
 
-  ~Camera()=default;
-  
-  const glm::mat4& GetPosition() const {return mPosition;}
-  const glm::mat4& GetFront() const {return mFront;}
-  const glm::mat4& GetViewMatrix() const {return mViewMatrix;}
-  const glm::mat4& GetProjectionMatrix() const {return mProjectionMatrix;}
+      const unsigned char* meshlets = reader.Skip((size_t)meshletCount * sizeof(Meshlet));
+      if(!meshlets) return false;
+      std::vector<Meshlet>& meshletTable = mesh.tables->meshlets;
+      meshletTable.resize(meshletCount);
+      memcpy(meshletTable.data(), meshlets, meshletTable.size() * sizeof(Meshlet));
+      for(auto& meshlet: meshletTable)
+        if((uint64_t)meshlet.indexOffset + meshlet.indexCount > indexCount) return false;
+      mesh.view.meshlets = meshletTable.data();
+      mesh.view.meshletCount = meshletTable.size();
+      mesh.view.vertexCount = vertexCount;
+      mesh.view.indexCount = indexCount;
+      mesh.view.format = (VertexFormat)format;
+      mesh.view.indexType = indexType;
 
-  void SetPosition(const glm::vec3& position) {mPosition = position;}
-  void SetFront(const glm::vec3& front) {mFront = front;}
+      mesh.textures.resize(textureCount);
+      for(auto& tex: mesh.textures){
+        uint32_t sourceCount;
+        if(!reader.ReadString(tex.type) || !reader.Read(sourceCount)) return false;
+        if(sourceCount != (tex.type == "texture_orm"? 3u : 1u)) return false;
+        tex.sources.resize(sourceCount);
+        for(auto& source: tex.sources){
+          if(!reader.ReadString(source.path)) return false;
+          if(!reader.Read(source.width) || !reader.Read(source.height) || !reader.Read(source.size)) return false;
+          source.embedded = source.size? reader.Skip(source.size) : nullptr;
+          if(source.size && !source.embedded) return false;
+        }
+      }
 
-  void Update(float dt){
-    mViewMatrix = glm::lookAt(mPosition, mPosition + mFront, mUp);
-    mProjectionMatrix = glm::perspective(glm::radians(mFov), (float)WIDTH/(float)HEIGHT, 0.1f, 1000.0f);
-    UpdateMovement(dt);
-  }
+      const unsigned char* v = reader.Align(16)? reader.Skip(mesh.view.vertexCount * VertexStride(mesh.view.format)) : nullptr;
+      const unsigned char* i = reader.Align(16)? reader.Skip(mesh.view.indexCount * IndexStride(mesh.view.indexType)) : nullptr;
+      if(!v || !i) return false;
+      mesh.view.vertices = v;
+      mesh.view.indices = i;
+    }
 
-  void UpdateMouse(float x, float y){
-    if(mFirstMouse){
-      mLastX = x;
-      mLastY = y;
-      mFirstMouse = false;
+    PushPlaceholder(glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+                    glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]));
+
+    std::vector<UploadItem> meshes(cached.size());
+    for(size_t i = 0; i < cached.size(); i++){
+      meshes[i].kind = UploadItem::MESH;
+      meshes[i].view = cached[i].view;
+      meshes[i].data = cached[i].tables;
+      for(auto& tex: cached[i].textures){
+        const size_t slot = (tex.type == "texture_orm")? QueueOrmTexture(tex.sources.data()) : QueueTexture(tex.sources[0], tex.type);
+        meshes[i].textures.push_back({tex.type, slot});
+      }
     }
 
-    float xoffset = x - mLastX;
-    float yoffset = mLastY - y;
+    mCacheFile = std::move(file);
+    StreamMeshes(meshes);
+    return true;
+  }
 
-    xoffset *= mSensitivity;
-    yoffset *= mSensitivity;
+public:
+  Model(): mParallelImport(true), mAsync(false), mSettingsKey(0), mUploadBudget(SIZE_MAX), mLoaded(false), mFailed(false), mCancel(false) {}
 
-    mLastX = x;
-    mLastY = y;
+  // blocking load, returns with every mesh and texture uploaded
+  Model(const std::string& path, const ModelSettings& settings = ModelSettings()): Model(){
+    Configure(path, settings);
+    Load(path);
+    PumpUploads(SIZE_MAX);
+  }
 
-    mYaw += xoffset;
-    mPitch += yoffset;
+  // returns immediately, meshes and textures appear in Draw as they finish streaming in
+  static std::unique_ptr<Model> LoadAsync(const std::string& path, const ModelSettings& settings = ModelSettings()){
+    std::unique_ptr<Model> model(new Model());
+    model->Configure(path, settings);
+    model->mAsync = true;
+    Model* m = model.get();
+    model->mLoader = std::thread([m, path]{m->Load(path);});
+    return model;
+  }
 
-    if(mPitch > 89.0f) mPitch = 89.0f;
-    if(mPitch < -89.0f) mPitch = -89.0f;
+  ~Model(){
+    mCancel = true;
+    if(mLoader.joinable()) mLoader.join();
+  }
 
-    glm::vec3 direction;
-    direction.x = glm::cos(glm::radians(mYaw)) * glm::cos(glm::radians(mPitch));
-    direction.y = glm::sin(glm::radians(mPitch));
-    direction.z = glm::sin(glm::radians(mYaw)) * glm::cos(glm::radians(mPitch));
+  Model(const Model&) = delete;
+  Model& operator=(const Model&) = delete;
 
-    mFront = glm::normalize(direction);
+  bool IsLoaded() const {return mLoaded;}
+  bool IsFailed() const {return mFailed;}
+  void SetUploadBudget(size_t bytes) {mUploadBudget = bytes;}
+
+  // uploads what the loader finished within this frame's budget. once per frame before any Submit,
+  // new meshes can move the existing ones, which a queue between Begin and Flush points at
+  void Update(){
+    PumpUploads(mUploadBudget);
   }
 
-  void UpdateScroll(float xoffset, float yoffset){
-    mFov -= yoffset;
+  // queues each mesh for queue's Flush at the LOD its projected screen-space error allows, culling
+  // meshes and meshlets. model is the matrix the meshes are drawn with
+  void Submit(RenderQueue& queue, Shader& shader, const Camera& camera, const glm::mat4& model = glm::mat4(1.0f)){
+    const float pixelScale = camera.GetProjectionMatrix()[1][1] * HEIGHT * 0.5f;
+    const glm::mat4 mvp = camera.GetProjectionMatrix() * camera.GetViewMatrix() * model;
+    const glm::vec3 modelCamera = glm::vec3(glm::inverse(model) * glm::vec4(camera.GetPosition(), 1.0f));
+    const CullContext cull = CullContext::From(mvp, modelCamera, mSettings.meshletConeCulling);
 
-    if(mFov < 1.0f) mFov = 1.0f;
-    if(mFov > 45.0f) mFov = 45.0f;
+    if(mSettings.streamTextures)
+      for(auto& mesh: mModelMeshes){
+        const float pixels = mesh.ScreenSize(model, camera.GetPosition(), pixelScale, cull);
+        if(pixels <= 0.0f) continue;
+        for(auto& texture: mesh.mTextures)
+          if(texture.id) TextureStreamer::Get().Request(texture.id, pixels);
+      }
+
+    const uint32_t instance = queue.AddInstance(model, cull);
+    if(mPlaceholder) queue.Add(shader, *mPlaceholder, instance, 0, false);
+    for(auto& mesh: mModelMeshes)
+      queue.Add(shader, mesh, instance, mesh.SelectLod(model, camera.GetPosition(), pixelScale, mSettings.lodPixelError), true);
   }
 };
 
@@ -607,16 +5537,46 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset){
   }
 }
 
+// tests/main_tests.cpp includes this file for its CPU-side code and brings its own main
+#ifndef PBR_NO_MAIN
 int main(int argc, char* argv[]){
-  
+  Profiler& profiler = Profiler::Get();
+  // --pack <archive> <root> writes every file below root into one archive and exits,
+  // --archive <archive> <root> serves the files below root from such an archive, with --check-archive
+  // loose files newer than their packed copy are read instead
+  if(argc == 4 && strcmp(argv[1], "--pack") == 0){
+    if(!AssetArchive::Pack(argv[2], argv[3])){
+      std::cerr<<"ERROR: packing archive -> "<<argv[2]<<std::endl;
+      exit(1);
+    }
+    return 0;
+  }
+  bool checkArchive = false;
+  for(int i = 1; i < argc; i++)
+    if(strcmp(argv[i], "--check-archive") == 0) checkArchive = true;
+  if(argc >= 4 && strcmp(argv[1], "--archive") == 0 && !AssetArchive::Mount(argv[2], argv[3], checkArchive)){
+    std::cerr<<"ERROR: mounting archive -> "<<argv[2]<<std::endl;
+    exit(1);
+  }
+
+  // --srgb samples colour maps as sRGB and encodes the output, for shaders that shade in linear light
+  // and leave gamma to GL. without it both stay as the shaders have always seen them
+  bool srgbOutput = false;
+  for(int i = 1; i < argc; i++)
+    if(strcmp(argv[i], "--srgb") == 0) srgbOutput = true;
+
+  int64_t phase = profiler.Now();
   if(glfwInit() < 0){
     std::cerr<<"ERROR: GLFW::Init()!"<<std::endl;
     exit(1);
   }
+  profiler.Record("glfwInit", "startup", phase, profiler.Now());
+  phase = profiler.Now();
 
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 
   window = glfwCreateWindow(WIDTH,
                             HEIGHT,
@@ -631,6 +5591,8 @@ int main(int argc, char* argv[]){
   }
 
   glfwMakeContextCurrent(window);
+  profiler.Record("window + context", "startup", phase, profiler.Now());
+  phase = profiler.Now();
 
   if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
     std::cerr<<"ERROR: GLAD::Init()!"<<std::endl;
@@ -639,45 +5601,102 @@ int main(int argc, char* argv[]){
     exit(1);
   }
 
-  Shader shader("../vert.glsl", "../frag.glsl");
-  Camera camera(6.0f, 0.1f);
-  glfwSetWindowUserPointer(window, &camera);
+  profiler.Record("gladLoadGLLoader", "startup", phase, profiler.Now());
+  phase = profiler.Now();
+
+  // everything in this scope owns GL objects and is gone before the context, the model first so its
+  // meshes hand their buffers and pool ranges back
+  {
+    // programs build on the driver's threads while the model streams in, frames draw with the
+    // batch's fallback program until they are ready
+    ShaderBatch shaders;
+    std::shared_ptr<Shader> pbrShader = shaders.Add("../vert.glsl", "../frag.glsl");
+    profiler.Record("shaders queued", "startup", phase, profiler.Now());
+    phase = profiler.Now();
+
+    UniformBuffer<FrameUniforms> frameUniforms(UNIFORM_BLOCKS[0].binding);
+    RenderQueue renderQueue;
+
+    Camera camera(6.0f, 0.1f);
+    glfwSetWindowUserPointer(window, &camera);
   
-  Model monkey("../monkey.obj");
+    ModelSettings settings;
+    settings.srgbTextures = srgbOutput;
+    std::unique_ptr<Model> monkey = Model::LoadAsync("../monkey.obj", settings);
+    profiler.Record("model queued", "startup", phase, profiler.Now());
+    bool firstFrame = true;
+    bool modelLoaded = false;
   
-  glEnable(GL_DEPTH_TEST);
+    GLState::Get().SetEnabled(GL_DEPTH_TEST, true);
+    GLState::Get().SetEnabled(GL_FRAMEBUFFER_SRGB, srgbOutput);
 
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetCursorPosCallback(window, mouse_callback);
-  glfwSetScrollCallback(window, scroll_callback);
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
   
-  while(!glfwWindowShouldClose(window)){
-    glfwPollEvents();
+    while(!glfwWindowShouldClose(window)){
+      glfwPollEvents();
 
-    UpdateTimer();
-    UpdateWindow();
+      UpdateTimer();
+      UpdateWindow();
 
-    ProcessInput();
+      ProcessInput();
     
-    camera.Update(dt);
+      camera.Update(dt);
 
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
-    glm::mat4 model = glm::mat4(1.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 projection = camera.GetProjectionMatrix();
+      glm::mat4 model = glm::mat4(1.0f);
+      glm::mat4 view = camera.GetViewMatrix();
+      glm::mat4 projection = camera.GetProjectionMatrix();
     
-    shader.Use();
-    shader.SetValue("model", model);
-    shader.SetValue("view", view);
-    shader.SetValue("projection", projection);
-    monkey.Draw(shader);
+      frameUniforms.Update({view, projection, glm::vec4(camera.GetPosition(), 1.0f)});
+
+      // programs that declare the Frame block read the buffer above and the queue fills the Object
+      // block per model, the plain uniforms are only set for programs that still declare them
+      shaders.Poll();
+      Shader& shader = shaders.Select(pbrShader);
+      shader.Use();
+      shader.SetValue(UNIFORM_VIEW, view);
+      shader.SetValue(UNIFORM_PROJECTION, projection);
+      monkey->Update();
+      // after the uploads, which add materials and can grow or replace array textures
+      MaterialTable::Get().Bind();
+      TextureArrayPool::Get().Bind();
+      renderQueue.Begin(camera.GetPosition());
+      monkey->Submit(renderQueue, shader, camera, model);
+      renderQueue.Flush();
+      TextureStreamer::Get().Update();
 
-    glfwSwapBuffers(window);
+      glfwSwapBuffers(window);
+      GLState::Get().EndFrame();
+
+      // time-to-first-frame and time-to-loaded-model are the startup KPIs the report leads with
+      if(firstFrame){
+        profiler.Mark("first frame");
+        firstFrame = false;
+      }
+      if(!modelLoaded && monkey->IsLoaded()){
+        profiler.Mark("model loaded");
+        modelLoaded = true;
+      }
+    }
+    glfwSetWindowUserPointer(window, nullptr);
   }
 
+  // singletons holding GL objects, after the models and locals above released what they used of them
+  MaterialTable::Get().Shutdown();
+  TextureArrayPool::Get().Shutdown();
+  GeometryPool::Shutdown();
+
+  profiler.WriteSummary(std::cout);
+  GLState::Get().WriteSummary(std::cout);
+  if(!profiler.WriteTrace("startup_trace.json"))
+    std::cerr<<"WARNING: writing startup_trace.json"<<std::endl;
+
   glfwDestroyWindow(window);
   glfwTerminate();
 }
+#endif
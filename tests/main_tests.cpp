@@ -0,0 +1,534 @@
+// CPU-side round-trip checks of the renderer's import and packing code, run as
+//   pbr_tests <suite>
+// main.cpp is compiled in without its main, nothing here needs a GL context
+#define PBR_NO_MAIN
+#include "../main.cpp"
+
+#include <filesystem>
+#include <random>
+#include <set>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  do{ \
+    if(!(condition)){ \
+      std::cerr<<"FAIL: "<<__FILE__<<":"<<__LINE__<<": "<<#condition<<std::endl; \
+      failures++; \
+    } \
+  }while(0)
+
+// mirrors OctDecode in the vertex shaders
+glm::vec3 OctDecode(glm::vec2 e){
+  glm::vec3 n(e, 1.0f - std::abs(e.x) - std::abs(e.y));
+  const float t = std::max(-n.z, 0.0f);
+  n.x += (n.x >= 0.0f)? -t : t;
+  n.y += (n.y >= 0.0f)? -t : t;
+  return glm::normalize(n);
+}
+
+void TestOctahedral(){
+  std::mt19937 rng(1);
+  std::normal_distribution<float> gauss;
+  float maxAngle = 0.0f;
+  for(int i = 0; i < 100000; i++){
+    glm::vec3 n(gauss(rng), gauss(rng), gauss(rng));
+    if(glm::length(n) < 1e-6f) continue;
+    n = glm::normalize(n);
+    const glm::vec3 decoded = OctDecode(glm::unpackSnorm2x16(glm::packSnorm2x16(OctEncode(n))));
+    maxAngle = std::max(maxAngle, std::atan2(glm::length(glm::cross(n, decoded)), glm::dot(n, decoded)));
+  }
+  // rounding moves each coordinate by at most half a 16-bit snorm step (1.5e-5), which the octahedral
+  // map turns into about 6.4e-5 radians at worst
+  CHECK(maxAngle < 1e-4f);
+
+  // the axes come back exactly, -z from the folded corners
+  const glm::vec3 axes[] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+  for(auto& axis: axes)
+    CHECK(glm::dot(OctDecode(glm::unpackSnorm2x16(glm::packSnorm2x16(OctEncode(axis)))), axis) > 0.99999f);
+}
+
+// (n + 1)^2 vertices over [0, n]^2, z from height
+MeshData BuildGrid(int n, const std::function<float(float, float)>& height){
+  MeshData mesh;
+  for(int y = 0; y <= n; y++)
+    for(int x = 0; x <= n; x++)
+      mesh.vertices.push_back({glm::vec3(x, y, height(x, y)), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(x, y) / (float)n});
+  for(int y = 0; y < n; y++)
+    for(int x = 0; x < n; x++){
+      const unsigned int i = y * (n + 1) + x;
+      const unsigned int quad[6] = {i, i + 1, i + n + 2, i, i + n + 2, i + n + 1};
+      mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+    }
+  return mesh;
+}
+
+// z of each triangle's cross product, the signed area doubled as seen from +z
+std::vector<float> FacingAreas(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices){
+  std::vector<float> areas;
+  for(size_t t = 0; t + 2 < indices.size(); t += 3){
+    const glm::vec3& a = vertices[indices[t]].position;
+    areas.push_back(glm::cross(vertices[indices[t + 1]].position - a, vertices[indices[t + 2]].position - a).z);
+  }
+  return areas;
+}
+
+void TestSimplify(){
+  // a flat grid collapses to the target without moving, flipping or dropping its fixed border
+  const int n = 32;
+  MeshData flat = BuildGrid(n, [](float, float){return 0.0f;});
+  float error = -1.0f;
+  const size_t target = flat.indices.size() / 4 / 3 * 3;
+  const std::vector<unsigned int> lod = SimplifyMesh(flat.vertices, flat.indices, target, 0.01f, error);
+  CHECK(!lod.empty() && lod.size() % 3 == 0);
+  CHECK(lod.size() <= target);
+  CHECK(error >= 0.0f && error <= 1e-5f);
+  for(unsigned int index: lod) CHECK(index < flat.vertices.size());
+
+  float area = 0.0f;
+  for(float a: FacingAreas(flat.vertices, lod)){
+    CHECK(a > 0.0f);
+    area += a;
+  }
+  CHECK(std::abs(area * 0.5f - n * n) < 1e-3f);
+
+  std::vector<bool> used(flat.vertices.size(), false);
+  for(unsigned int index: lod) used[index] = true;
+  for(int i = 0; i <= n; i++){
+    CHECK(used[i] && used[n * (n + 1) + i]);
+    CHECK(used[i * (n + 1)] && used[i * (n + 1) + n]);
+  }
+
+  // on a curved surface the reported error respects the bound and the LOD chain only grows coarser
+  MeshData wavy = BuildGrid(n, [](float x, float y){return std::sin(x * 0.3f) * std::cos(y * 0.2f);});
+  ComputeBounds(wavy.vertices.data(), wavy.vertices.size(), wavy.boundsMin, wavy.boundsMax);
+  wavy.BuildLods(4, 0.02f);
+  const float maxError = 0.02f * glm::length(wavy.boundsMax - wavy.boundsMin);
+  CHECK(wavy.lods.size() >= 2);
+  for(size_t l = 1; l < wavy.lods.size(); l++){
+    CHECK(wavy.lods[l].indexCount < wavy.lods[l - 1].indexCount);
+    CHECK(wavy.lods[l].error >= wavy.lods[l - 1].error);
+    CHECK(wavy.lods[l].error - wavy.lods[l - 1].error <= maxError);
+  }
+}
+
+void TestMeshlets(){
+  const int n = 40;
+  MeshData mesh = BuildGrid(n, [](float x, float y){return 4.0f * std::sin(x * 0.25f) * std::cos(y * 0.15f);});
+  const std::vector<Meshlet> meshlets = BuildMeshlets(mesh.vertices, mesh.indices, mesh.indices.size());
+
+  // consecutive index ranges within the vertex and triangle limits, whose spheres hold their vertices
+  size_t next = 0;
+  for(auto& meshlet: meshlets){
+    CHECK(meshlet.indexOffset == next && meshlet.indexCount > 0 && meshlet.indexCount % 3 == 0);
+    CHECK(meshlet.indexCount / 3 <= 124);
+    std::set<unsigned int> unique(mesh.indices.begin() + meshlet.indexOffset, mesh.indices.begin() + meshlet.indexOffset + meshlet.indexCount);
+    CHECK(unique.size() <= 64);
+    for(unsigned int v: unique) CHECK(glm::length(mesh.vertices[v].position - meshlet.center) <= meshlet.radius * 1.0001f + 1e-5f);
+    next += meshlet.indexCount;
+  }
+  CHECK(next == mesh.indices.size());
+
+  // culling is conservative: a meshlet with any triangle facing the camera stays visible
+  CullContext cull = {};
+  for(auto& plane: cull.planes) plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  cull.coneCulling = true;
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> around(-60.0f, 100.0f);
+  size_t culled = 0;
+  for(int c = 0; c < 200; c++){
+    cull.cameraPos = glm::vec3(around(rng), around(rng), around(rng));
+    for(auto& meshlet: meshlets){
+      bool facing = false;
+      for(uint32_t i = meshlet.indexOffset; i < meshlet.indexOffset + meshlet.indexCount; i += 3){
+        const glm::vec3& a = mesh.vertices[mesh.indices[i]].position;
+        const glm::vec3 normal = glm::cross(mesh.vertices[mesh.indices[i + 1]].position - a, mesh.vertices[mesh.indices[i + 2]].position - a);
+        facing = facing || glm::dot(normal, cull.cameraPos - a) > 0.0f;
+      }
+      const bool visible = cull.IsMeshletVisible(meshlet);
+      CHECK(visible || !facing);
+      culled += !visible;
+    }
+  }
+  // and from below the surface some meshlets are actually dropped
+  CHECK(culled > 0);
+}
+
+void TestRangeAllocator(){
+  // checked against a per-element map of what is in use, first fit means the lowest gap that fits
+  const size_t capacity = 4096;
+  RangeAllocator allocator;
+  allocator.Grow(capacity / 2);
+  allocator.Grow(capacity);
+  CHECK(allocator.Capacity() == capacity);
+  std::vector<bool> inUse(capacity, false);
+  std::vector<std::pair<size_t, size_t>> live;
+
+  auto firstFit = [&](size_t size){
+    size_t run = 0;
+    for(size_t i = 0; i < capacity; i++){
+      run = inUse[i]? 0 : run + 1;
+      if(run == size) return i + 1 - size;
+    }
+    return RangeAllocator::INVALID;
+  };
+
+  std::mt19937 rng(3);
+  for(int step = 0; step < 20000; step++){
+    if(live.empty() || rng() % 5 < 3){
+      const size_t size = 1 + rng() % 96;
+      const size_t offset = allocator.Allocate(size);
+      CHECK(offset == firstFit(size));
+      if(offset == RangeAllocator::INVALID) continue;
+      for(size_t i = offset; i < offset + size; i++) inUse[i] = true;
+      live.emplace_back(offset, size);
+    }
+    else{
+      const size_t k = rng() % live.size();
+      allocator.Free(live[k].first, live[k].second);
+      for(size_t i = live[k].first; i < live[k].first + live[k].second; i++) inUse[i] = false;
+      live[k] = live.back();
+      live.pop_back();
+    }
+  }
+
+  // everything freed merges back into one block
+  for(auto& range: live) allocator.Free(range.first, range.second);
+  CHECK(allocator.Allocate(capacity) == 0);
+  CHECK(allocator.Allocate(1) == RangeAllocator::INVALID);
+}
+
+// reference decoders, written from the format specs rather than from the encoders
+void DecodeBC1Block(const unsigned char* in, float out[16][4]){
+  const uint16_t c0 = in[0] | (in[1] << 8);
+  const uint16_t c1 = in[2] | (in[3] << 8);
+  float palette[4][4];
+  From565(c0, palette[0]);
+  From565(c1, palette[1]);
+  for(int c = 0; c < 4; c++){
+    if(c0 > c1){
+      palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+      palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    else{
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+      palette[3][c] = 0.0f;
+    }
+  }
+  const uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+  for(int i = 0; i < 16; i++) memcpy(out[i], palette[(bits >> (2 * i)) & 3], sizeof(out[i]));
+}
+
+void DecodeBC4Block(const unsigned char* in, float out[16]){
+  const int a0 = in[0];
+  const int a1 = in[1];
+  float palette[8] = {(float)a0, (float)a1};
+  for(int k = 2; k < 8; k++){
+    if(a0 > a1) palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7.0f;
+    else palette[k] = (k < 6)? ((6 - k) * a0 + (k - 1) * a1) / 5.0f : (k == 6)? 0.0f : 255.0f;
+  }
+  uint64_t bits = 0;
+  for(int i = 0; i < 6; i++) bits |= (uint64_t)in[2 + i] << (8 * i);
+  for(int i = 0; i < 16; i++) out[i] = palette[(bits >> (3 * i)) & 7];
+}
+
+// mode 6 only, the one EncodeBC7Block writes. false for any other mode
+bool DecodeBC7Block(const unsigned char* in, float out[16][4]){
+  uint64_t words[2];
+  memcpy(words, in, 16);
+  int position = 0;
+  auto get = [&](int count){
+    uint32_t value = 0;
+    for(int b = 0; b < count; b++, position++) value |= (uint32_t)((words[position >> 6] >> (position & 63)) & 1) << b;
+    return value;
+  };
+  if(get(7) != (1u << 6)) return false;
+  int ends[2][4];
+  for(int c = 0; c < 4; c++){
+    ends[0][c] = get(7) << 1;
+    ends[1][c] = get(7) << 1;
+  }
+  const int p0 = get(1);
+  const int p1 = get(1);
+  for(int c = 0; c < 4; c++){
+    ends[0][c] |= p0;
+    ends[1][c] |= p1;
+  }
+  static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+  for(int i = 0; i < 16; i++){
+    const int index = get(i == 0? 3 : 4);
+    for(int c = 0; c < 4; c++) out[i][c] = (float)(((64 - weights[index]) * ends[0][c] + weights[index] * ends[1][c] + 32) >> 6);
+  }
+  return true;
+}
+
+// a 4x4 block varying linearly between two random colours along a random direction, noise adds
+// +-noise per channel on top
+void GradientBlock(std::mt19937& rng, float noise, float block[16][4]){
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  float a[4], b[4];
+  for(int c = 0; c < 4; c++){
+    a[c] = unit(rng) * 255.0f;
+    b[c] = unit(rng) * 255.0f;
+  }
+  const float dx = unit(rng), dy = 1.0f - dx;
+  for(int i = 0; i < 16; i++){
+    const float t = ((i & 3) * dx + (i >> 2) * dy) / 3.0f;
+    for(int c = 0; c < 4; c++)
+      block[i][c] = std::round(std::min(255.0f, std::max(0.0f, a[c] + (b[c] - a[c]) * t + (unit(rng) * 2.0f - 1.0f) * noise)));
+  }
+}
+
+float RootMeanSquare(const float a[16][4], const float b[16][4], int first, int count){
+  float sum = 0.0f;
+  for(int i = 0; i < 16; i++)
+    for(int c = first; c < first + count; c++) sum += (a[i][c] - b[i][c]) * (a[i][c] - b[i][c]);
+  return std::sqrt(sum / (16.0f * count));
+}
+
+// rms error of spreading uniformly distributed values over levels evenly spaced steps across range
+float QuantizationError(float range, int levels){
+  return range / (levels - 1) / std::sqrt(12.0f);
+}
+
+void TestBlockCompression(){
+  // each format is held to a multiple of the error its palette size alone implies for the block's
+  // largest channel range, plus its endpoint precision and the added noise
+  std::mt19937 rng(4);
+  float worst[3] = {0.0f, 0.0f, 0.0f};
+  for(int n = 0; n < 2000; n++){
+    float block[16][4], decoded[16][4];
+    unsigned char bytes[16];
+    const float noise = (n % 2)? 4.0f : 0.0f;
+    GradientBlock(rng, noise, block);
+    float range[4];
+    for(int c = 0; c < 4; c++){
+      float lo = 255.0f, hi = 0.0f;
+      for(int i = 0; i < 16; i++){
+        lo = std::min(lo, block[i][c]);
+        hi = std::max(hi, block[i][c]);
+      }
+      range[c] = hi - lo;
+    }
+    const float rgbRange = std::max(range[0], std::max(range[1], range[2]));
+
+    EncodeBC1Block(block, bytes);
+    DecodeBC1Block(bytes, decoded);
+    worst[0] = std::max(worst[0], RootMeanSquare(block, decoded, 0, 3) / (QuantizationError(rgbRange, 4) + 4.0f + noise));
+
+    for(int c = 0; c < 4; c++){
+      EncodeBC4Block(block, c, bytes);
+      float values[16];
+      DecodeBC4Block(bytes, values);
+      for(int i = 0; i < 16; i++) decoded[i][c] = values[i];
+      worst[1] = std::max(worst[1], RootMeanSquare(block, decoded, c, 1) / (QuantizationError(range[c], 8) + 1.0f + noise));
+    }
+
+    EncodeBC7Block(block, bytes);
+    CHECK(DecodeBC7Block(bytes, decoded));
+    worst[2] = std::max(worst[2], RootMeanSquare(block, decoded, 0, 4) / (QuantizationError(std::max(rgbRange, range[3]), 16) + 2.0f + noise));
+  }
+  CHECK(worst[0] < 2.0f);
+  CHECK(worst[1] < 2.0f);
+  CHECK(worst[2] < 2.0f);
+
+  // flat blocks: BC4 and BC7 exact (BC7 to the p-bit), BC1 to the 565 step
+  for(int n = 0; n < 256; n++){
+    float block[16][4], decoded[16][4];
+    unsigned char bytes[16];
+    for(int i = 0; i < 16; i++){
+      block[i][0] = n;
+      block[i][1] = 255 - n;
+      block[i][2] = (n * 7) & 255;
+      block[i][3] = (n * 13) & 255;
+    }
+    EncodeBC1Block(block, bytes);
+    DecodeBC1Block(bytes, decoded);
+    CHECK(std::abs(decoded[0][0] - block[0][0]) <= 4.0f && std::abs(decoded[0][1] - block[0][1]) <= 2.0f && std::abs(decoded[0][2] - block[0][2]) <= 4.0f);
+    EncodeBC4Block(block, 3, bytes);
+    float values[16];
+    DecodeBC4Block(bytes, values);
+    CHECK(values[5] == block[5][3]);
+    EncodeBC7Block(block, bytes);
+    CHECK(DecodeBC7Block(bytes, decoded));
+    for(int c = 0; c < 4; c++) CHECK(std::abs(decoded[7][c] - block[7][c]) <= 1.0f);
+  }
+}
+
+void WriteFile(const std::string& path, const std::string& bytes){
+  std::ofstream(path, std::ios::binary)<<bytes;
+}
+
+std::string ReadMapped(const std::string& path){
+  MappedFile file;
+  if(!file.Open(path)) return "<missing>";
+  return std::string(reinterpret_cast<const char*>(file.Data()), file.Size());
+}
+
+void TestArchive(){
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / ("pbr_tests_archive_" + std::to_string(getpid()));
+  std::filesystem::remove_all(dir);
+  const std::string root = (dir / "assets").string();
+  const std::string stale = (dir / "stale").string();
+  std::filesystem::create_directories(root + "/models/textures");
+  std::filesystem::create_directories(stale);
+
+  std::mt19937 rng(5);
+  std::map<std::string, std::string> files;
+  const char* names[] = {"shader.vs", "models/a.obj", "models/a.obj.preview.meshcache", "models/textures/b.png", "models/textures/b.png.rgb8.ktc"};
+  for(size_t i = 0; i < 5; i++){
+    std::string bytes(1 + rng() % (i * 40000 + 100), '\0');
+    for(char& c: bytes) c = (char)rng();
+    files[names[i]] = bytes;
+    WriteFile(root + "/" + names[i], bytes);
+  }
+  WriteFile(stale + "/old.bin", "packed");
+  WriteFile(stale + "/new.bin", "packed");
+
+  CHECK(AssetArchive::Pack((dir / "assets.pak").string(), root));
+  CHECK(AssetArchive::Pack((dir / "stale.pak").string(), stale));
+  CHECK(AssetArchive::Mount((dir / "assets.pak").string(), root));
+
+  // every file comes back byte for byte, blobs keep the archive alignment, and rewriting or removing
+  // the loose files does not change what the mounted archive serves
+  for(auto& file: files){
+    const std::string path = root + "/./models/../" + file.first;
+    MappedFile mapped;
+    CHECK(mapped.Open(path));
+    CHECK(AssetArchive::Contains(path));
+    // the archive mapping starts on a page, so aligned offsets are aligned addresses
+    CHECK(reinterpret_cast<uintptr_t>(mapped.Data()) % ASSET_ARCHIVE_ALIGNMENT == 0);
+    WriteFile(root + "/" + file.first, "rewritten");
+    CHECK(ReadMapped(path) == file.second);
+    std::filesystem::remove(root + "/" + file.first);
+    CHECK(ReadMapped(path) == file.second);
+  }
+  CHECK(!AssetArchive::Contains(root + "/models/missing.obj"));
+  CHECK(ReadMapped(root + "/models/missing.obj") == "<missing>");
+  CHECK(!AssetArchive::Contains((dir / "assets.pak").string()));
+
+  // --check-archive: a loose file newer than the archive wins, decided once at Mount
+  WriteFile(stale + "/new.bin", "loose");
+  const auto later = std::filesystem::last_write_time(dir / "stale.pak") + std::chrono::seconds(10);
+  std::filesystem::last_write_time(stale + "/new.bin", later);
+  CHECK(AssetArchive::Mount((dir / "stale.pak").string(), stale, true));
+  CHECK(ReadMapped(stale + "/new.bin") == "loose");
+  CHECK(ReadMapped(stale + "/old.bin") == "packed");
+  std::filesystem::remove(stale + "/old.bin");
+  CHECK(ReadMapped(stale + "/old.bin") == "packed");
+
+  std::filesystem::remove_all(dir);
+}
+
+void TestRadixSort(){
+  // stable, so equal keys keep their submission order, which std::stable_sort shows the expected result of
+  std::mt19937_64 rng(6);
+  std::vector<SortEntry> entries, scratch;
+  for(int run = 0; run < 200; run++){
+    const size_t count = (run < 3)? run : 1 + rng() % 5000;
+    // full random keys, keys differing only in a few digits, and keys with many duplicates
+    const uint64_t mask = (run % 3 == 0)? ~0ull : (run % 3 == 1)? (0xFFull << 24) | 0xF00F : 0x3ull << 60;
+    const uint64_t base = rng() & ~mask;
+    entries.resize(count);
+    for(size_t i = 0; i < count; i++) entries[i] = {base | (rng() & mask), (uint32_t)i};
+
+    std::vector<SortEntry> expected = entries;
+    std::stable_sort(expected.begin(), expected.end(), [](const SortEntry& a, const SortEntry& b){return a.key < b.key;});
+    RadixSort(entries, scratch);
+    CHECK(entries.size() == count);
+    bool same = true;
+    for(size_t i = 0; i < count; i++) same = same && entries[i].key == expected[i].key && entries[i].index == expected[i].index;
+    CHECK(same);
+  }
+}
+
+// a freshly decoded image of channels bytes per pixel, as stb_image returns them
+DecodedImage SourceImage(int width, int height, int channels, const std::function<unsigned char(int, int, int)>& texel){
+  DecodedImage image;
+  image.width = width;
+  image.height = height;
+  image.channels = channels;
+  image.pixels.reset(static_cast<unsigned char*>(malloc((size_t)width * height * channels)));
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+      for(int c = 0; c < channels; c++) image.pixels.get()[((size_t)y * width + x) * channels + c] = texel(x, y, c);
+  return image;
+}
+
+DecodedImage Bake(DecodedImage source, TextureUsage usage, const BakeOptions& options){
+  PrepareForBaking(source, usage, options);
+  return PackImage(GenerateMips(source, usage), usage, options);
+}
+
+void TestTexturePacking(){
+  auto grey = [](int x, int y, int c){return (unsigned char)((c == 1)? 255 - x * 8 : x * 4 + y * 3);};
+  auto colour = [](int x, int y, int c){return (unsigned char)(x * 5 + y * 3 + c * 40);};
+  const BakeOptions defaults;
+
+  // grey and grey+alpha keep one and two channels, every level holding the source's grey and alpha
+  for(int channels = 1; channels <= 2; channels++)
+    for(TextureUsage usage: {TextureUsage::Color, TextureUsage::Mask}){
+      const DecodedImage image = Bake(SourceImage(32, 16, channels, grey), usage, defaults);
+      CHECK(image.grey);
+      CHECK(image.format == ((channels == 1)? GL_R8 : GL_RG8));
+      CHECK(image.levels.size() == 6);
+      CHECK(image.levels.back().width == 1 && image.levels.back().height == 1);
+      for(auto& level: image.levels) CHECK(level.size == (size_t)level.width * level.height * channels);
+      bool same = true;
+      for(int i = 0; i < 32 * 16; i++)
+        for(int c = 0; c < channels; c++) same = same && image.LevelPointer(0)[i * channels + c] == grey(i % 32, i / 32, c);
+      CHECK(same);
+    }
+
+  // colour stays RGB, and grey colour maps baked for sRGB keep three channels
+  DecodedImage image = Bake(SourceImage(16, 16, 3, colour), TextureUsage::Color, defaults);
+  CHECK(!image.grey && image.format == GL_RGB8);
+  BakeOptions srgb;
+  srgb.srgb = true;
+  image = Bake(SourceImage(16, 16, 1, grey), TextureUsage::Color, srgb);
+  CHECK(!image.grey && image.format == GL_SRGB8);
+
+  // compact normals and masks are plain RG8 and R8, never swizzled
+  BakeOptions compact;
+  compact.compact = true;
+  image = Bake(SourceImage(16, 16, 3, colour), TextureUsage::Normal, compact);
+  CHECK(!image.grey && image.format == GL_RG8);
+  image = Bake(SourceImage(16, 16, 1, grey), TextureUsage::Mask, compact);
+  CHECK(!image.grey && image.format == GL_R8);
+
+  // the grey flag survives the .ktc cache
+  const DecodedImage baked = Bake(SourceImage(8, 8, 2, grey), TextureUsage::Color, defaults);
+  const std::string path = (std::filesystem::temp_directory_path() / ("pbr_tests_" + std::to_string(getpid()) + ".ktc")).string();
+  CHECK(SaveTextureCache(path, 42, baked));
+  DecodedImage loaded;
+  CHECK(LoadTextureCache(path, 42, loaded));
+  CHECK(loaded.grey && loaded.format == GL_RG8 && loaded.levels.size() == baked.levels.size());
+  for(size_t i = 0; i < baked.levels.size() && i < loaded.levels.size(); i++)
+    CHECK(loaded.levels[i].size == baked.levels[i].size && memcmp(loaded.LevelPointer(i), baked.LevelPointer(i), baked.levels[i].size) == 0);
+  std::filesystem::remove(path);
+}
+
+int main(int argc, char* argv[]){
+  static const std::pair<const char*, void (*)()> suites[] = {
+    {"octahedral", TestOctahedral},
+    {"simplify", TestSimplify},
+    {"meshlets", TestMeshlets},
+    {"ranges", TestRangeAllocator},
+    {"bc", TestBlockCompression},
+    {"archive", TestArchive},
+    {"radix", TestRadixSort},
+    {"textures", TestTexturePacking},
+  };
+  if(argc != 2){
+    std::cerr<<"usage: pbr_tests <suite>"<<std::endl;
+    return 2;
+  }
+  for(auto& suite: suites){
+    if(strcmp(argv[1], suite.first) != 0) continue;
+    suite.second();
+    if(failures) std::cerr<<suite.first<<": "<<failures<<" failed"<<std::endl;
+    return failures? 1 : 0;
+  }
+  std::cerr<<"ERROR: unknown suite -> "<<argv[1]<<std::endl;
+  return 2;
+}